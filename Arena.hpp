@@ -0,0 +1,151 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+/* Arena.hpp
+ *
+ * A monotonic slab arena and a matching std::allocator-compatible
+ * allocator, for building BinarySearchTree and Map instances whose
+ * nodes live in a few contiguous slabs instead of one heap block each.
+ *
+ * Example:
+ *   Arena arena;
+ *   Map<std::string, int, std::less<std::string>, NoBalance,
+ *       ArenaAllocator<std::pair<std::string, int>>> words(arena);
+ */
+
+#include <cstddef> //size_t, max_align_t
+#include <memory>  //align
+#include <new>     //operator new, bad_alloc
+
+class Arena {
+  // OVERVIEW: Hands out memory from large slabs, bumping a cursor for
+  //           each request. Individual blocks are never freed; all of the
+  //           slabs are released together when the Arena is destroyed,
+  //           which costs one free per slab rather than one per block.
+  //           Objects placed in the arena must still be destroyed by
+  //           their owner before the arena goes away.
+
+public:
+  // Slabs are this many bytes unless a single request needs more.
+  static const size_t default_slab_size = 64 * 1024;
+
+  explicit Arena(size_t slab_size_in = default_slab_size)
+    : slabs(nullptr), cursor(nullptr), limit(nullptr),
+      slab_size(slab_size_in), num_allocations(0), num_slabs(0) { }
+
+  // An Arena owns its slabs, so it cannot be copied
+  Arena(const Arena &other) = delete;
+  Arena &operator=(const Arena &rhs) = delete;
+
+  // Destructor
+  ~Arena() {
+    release();
+  }
+
+  // EFFECTS: Returns a block of at least 'bytes' bytes aligned to 'align',
+  //          starting a new slab if the current one is full.
+  void *allocate(size_t bytes, size_t align = alignof(std::max_align_t)) {
+    size_t space = static_cast<size_t>(limit - cursor);
+    void *block = cursor;
+    if (!cursor || !std::align(align, bytes, block, space)) {
+      add_slab(bytes + align);
+      space = static_cast<size_t>(limit - cursor);
+      block = cursor;
+      std::align(align, bytes, block, space);
+    }
+    cursor = static_cast<char *>(block) + bytes;
+    ++num_allocations;
+    return block;
+  }
+
+  // MODIFIES: this
+  // EFFECTS:  Frees every slab at once. Any memory handed out by this
+  //           Arena is invalid afterwards.
+  void release() {
+    while (slabs) {
+      Slab *next = slabs->next;
+      ::operator delete(slabs);
+      slabs = next;
+    }
+    cursor = limit = nullptr;
+    num_slabs = 0;
+  }
+
+  // EFFECTS: Returns the number of blocks handed out so far.
+  size_t allocation_count() const {
+    return num_allocations;
+  }
+
+  // EFFECTS: Returns the number of slabs requested from the heap.
+  size_t slab_count() const {
+    return num_slabs;
+  }
+
+private:
+  // Each slab begins with a header linking it to the previous slab
+  struct Slab {
+    Slab *next;
+  };
+
+  Slab *slabs;
+  char *cursor;
+  char *limit;
+  size_t slab_size;
+  size_t num_allocations;
+  size_t num_slabs;
+
+  // MODIFIES: this
+  // EFFECTS:  Starts a new slab with room for at least 'bytes' bytes.
+  void add_slab(size_t bytes) {
+    size_t size = sizeof(Slab) + (bytes > slab_size ? bytes : slab_size);
+    Slab *slab = static_cast<Slab *>(::operator new(size));
+    slab->next = slabs;
+    slabs = slab;
+    cursor = reinterpret_cast<char *>(slab + 1);
+    limit = reinterpret_cast<char *>(slab) + size;
+    ++num_slabs;
+  }
+};
+
+template <typename T>
+class ArenaAllocator {
+  // OVERVIEW: A std::allocator-compatible allocator that takes its memory
+  //           from an Arena. deallocate() is a no-op; the memory comes
+  //           back when the Arena is destroyed. Two ArenaAllocators
+  //           compare equal when they share an Arena.
+
+public:
+  using value_type = T;
+
+  ArenaAllocator(Arena &arena_in)
+    : arena(&arena_in) { }
+
+  // Converting constructor, used when a container rebinds the allocator
+  // to its node type
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U> &other)
+    : arena(other.arena) { }
+
+  T *allocate(size_t n) {
+    return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T *, size_t) { }
+
+  template <typename U>
+  bool operator==(const ArenaAllocator<U> &rhs) const {
+    return arena == rhs.arena;
+  }
+
+  template <typename U>
+  bool operator!=(const ArenaAllocator<U> &rhs) const {
+    return arena != rhs.arena;
+  }
+
+private:
+  template <typename U>
+  friend class ArenaAllocator;
+
+  Arena *arena;
+};
+
+#endif // ARENA_HPP
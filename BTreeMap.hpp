@@ -0,0 +1,592 @@
+#ifndef BTREE_MAP_HPP
+#define BTREE_MAP_HPP
+/* BTreeMap.hpp
+ *
+ * An ordered map of key-value pairs with unique keys, stored in a B+-tree.
+ * Offers the same interface as Map (find, operator[], insert, ordered
+ * begin/end iteration, ...) so either can be used, e.g. in the
+ * Classifier.
+ *
+ * Compared with the BinarySearchTree behind Map, each node holds up to
+ * Fanout entries in contiguous arrays, so a search touches about
+ * log_Fanout(n) nodes instead of log_2(n), and there are far fewer
+ * pointers per entry.
+ */
+
+#include <algorithm>  //lower_bound, upper_bound, move, move_backward
+#include <cassert>    //assert
+#include <cstddef>    //size_t
+#include <functional> //less
+#include <utility>    //pair, move
+
+template <typename Key_type, typename Value_type,
+          typename Key_compare=std::less<Key_type>, // default argument
+          size_t Fanout=16 // maximum children per node
+         >
+class BTreeMap {
+
+  // OVERVIEW: A B+-tree. Every key-value pair lives in a leaf; leaves are
+  //           linked in key order for iteration. Inner nodes hold only
+  //           separator keys and child pointers: keys[i] is the smallest
+  //           key in the subtree children[i + 1]. All leaves are at the
+  //           same depth.
+  //
+  // NOTE: Like the arrays inside each node, Key_type and Value_type must
+  //       be default constructible. Moving them must not throw.
+  //
+  // WARNING: Unlike Map, inserting may move existing elements between
+  //          nodes, so insert, operator[] and try_emplace invalidate all
+  //          iterators and references into the BTreeMap.
+
+  static_assert(Fanout >= 4, "BTreeMap needs a fanout of at least 4");
+
+private:
+  using Pair_type = std::pair<Key_type, Value_type>;
+
+  // Enables an overload only when Key_compare is transparent
+  template <typename C>
+  using Transparent = typename C::is_transparent;
+
+  // Fields shared by leaves and inner nodes
+  struct Node {
+    bool is_leaf;
+    size_t count; // number of elements (leaf) or keys (inner node)
+  };
+
+  struct Leaf : Node {
+    Pair_type elements[Fanout];
+    Leaf *next;
+  };
+
+  struct Inner : Node {
+    Key_type keys[Fanout - 1];
+    Node *children[Fanout];
+  };
+
+public:
+
+  class Iterator {
+    // OVERVIEW: Iterates over the key-value pairs in ascending key order
+    //           by walking the linked list of leaves.
+
+  public:
+    Iterator()
+      : leaf(nullptr), index(0) { }
+
+    std::pair<Key_type, Value_type> &operator*() const {
+      return leaf->elements[index];
+    }
+
+    std::pair<Key_type, Value_type> *operator->() const {
+      return &leaf->elements[index];
+    }
+
+    // Prefix ++
+    Iterator &operator++() {
+      if (++index == leaf->count) {
+        leaf = leaf->next;
+        index = 0;
+      }
+      return *this;
+    }
+
+    // Postfix ++ (implemented in terms of prefix ++)
+    Iterator operator++(int) {
+      Iterator result(*this);
+      ++(*this);
+      return result;
+    }
+
+    bool operator==(const Iterator &rhs) const {
+      return leaf == rhs.leaf && index == rhs.index;
+    }
+
+    bool operator!=(const Iterator &rhs) const {
+      return !(*this == rhs);
+    }
+
+  private:
+    friend class BTreeMap;
+
+    Leaf *leaf;
+    size_t index;
+
+    Iterator(Leaf *leaf_in, size_t index_in)
+      : leaf(leaf_in), index(index_in) { }
+  };
+
+  // Default constructor
+  BTreeMap()
+    : root(nullptr), first_leaf(nullptr), num_elements(0) { }
+
+  // Copy constructor
+  BTreeMap(const BTreeMap &other)
+    : root(nullptr), first_leaf(nullptr), num_elements(other.num_elements) {
+    Leaf *last_leaf = nullptr;
+    root = copy_node(other.root, last_leaf);
+  }
+
+  // Move constructor
+  BTreeMap(BTreeMap &&other) noexcept
+    : root(other.root), first_leaf(other.first_leaf),
+      num_elements(other.num_elements) {
+    other.root = nullptr;
+    other.first_leaf = nullptr;
+    other.num_elements = 0;
+  }
+
+  // Assignment operator (copy-and-swap, covers copy and move)
+  BTreeMap &operator=(BTreeMap rhs) {
+    std::swap(root, rhs.root);
+    std::swap(first_leaf, rhs.first_leaf);
+    std::swap(num_elements, rhs.num_elements);
+    return *this;
+  }
+
+  // Destructor
+  ~BTreeMap() {
+    destroy_node(root);
+  }
+
+  // EFFECTS : Returns whether this BTreeMap is empty.
+  bool empty() const {
+    return num_elements == 0;
+  }
+
+  // EFFECTS : Returns the number of elements in this BTreeMap.
+  size_t size() const {
+    return num_elements;
+  }
+
+  // EFFECTS : Returns an Iterator to the element with key k, or an end
+  //           Iterator if there is none.
+  Iterator find(const Key_type &k) const {
+    return find_key(k);
+  }
+
+  // EFFECTS : Same as above, for any type a transparent Key_compare can
+  //           compare with Key_type.
+  template <typename K, typename C = Key_compare, typename = Transparent<C>>
+  Iterator find(const K &k) const {
+    return find_key(k);
+  }
+
+  // EFFECTS : Returns whether this BTreeMap holds an element with key k.
+  bool contains(const Key_type &k) const {
+    return find(k) != end();
+  }
+
+  // EFFECTS : Same as above, for a transparent Key_compare.
+  template <typename K, typename C = Key_compare, typename = Transparent<C>>
+  bool contains(const K &k) const {
+    return find(k) != end();
+  }
+
+  // EFFECTS : Returns the number of elements with key k (0 or 1).
+  size_t count(const Key_type &k) const {
+    return contains(k) ? 1 : 0;
+  }
+
+  // EFFECTS : Same as above, for a transparent Key_compare.
+  template <typename K, typename C = Key_compare, typename = Transparent<C>>
+  size_t count(const K &k) const {
+    return contains(k) ? 1 : 0;
+  }
+
+  // MODIFIES: this
+  // EFFECTS : Returns a reference to the value for key k, inserting a
+  //           value-initialized one first if k is not present.
+  Value_type &operator[](const Key_type &k) {
+    return try_emplace(k).first->second;
+  }
+
+  // MODIFIES: this
+  // EFFECTS : Same as above, for a transparent Key_compare. A Key_type is
+  //           only built from k if a new element has to be inserted.
+  template <typename K, typename C = Key_compare, typename = Transparent<C>>
+  Value_type &operator[](const K &k) {
+    Iterator it = find(k);
+    if (it != end()) {
+      return it->second;
+    }
+    return try_emplace(Key_type(k)).first->second;
+  }
+
+  // MODIFIES: this
+  // EFFECTS : Inserts val if its key is not already present. Returns an
+  //           Iterator to the element with that key, along with whether
+  //           val was inserted.
+  std::pair<Iterator, bool> insert(const Pair_type &val) {
+    return try_emplace(val.first, val.second);
+  }
+
+  // MODIFIES: this
+  // EFFECTS : If k is not present, inserts an element with key k and a
+  //           value constructed from args. Returns an Iterator to the
+  //           element with key k, along with whether it was inserted.
+  //           If building the element, or the nodes and separator key a
+  //           split needs, throws, this BTreeMap is left unchanged.
+  template <typename K, typename... Args>
+  std::pair<Iterator, bool> try_emplace(K &&k, Args &&... args) {
+    if (!root) {
+      Leaf *leaf = new_leaf();
+      root = first_leaf = leaf;
+    }
+
+    // Descend to the leaf, remembering the path for splits
+    Inner *path[max_depth];
+    size_t path_index[max_depth];
+    size_t depth = 0;
+    Node *node = root;
+    while (!node->is_leaf) {
+      Inner *inner = static_cast<Inner *>(node);
+      size_t i = child_index(inner, k);
+      path[depth] = inner;
+      path_index[depth] = i;
+      ++depth;
+      node = inner->children[i];
+    }
+
+    Leaf *leaf = static_cast<Leaf *>(node);
+    size_t pos = element_index(leaf, k);
+    if (pos < leaf->count && !less(k, leaf->elements[pos].first)) {
+      return {Iterator(leaf, pos), false};
+    }
+
+    // Build the element before moving anything over to make room for it,
+    // so a constructor that throws cannot leave a hole in the leaf
+    Pair_type element(std::forward<K>(k),
+                      Value_type(std::forward<Args>(args)...));
+
+    if (leaf->count == Fanout) {
+      // Copy the separator and allocate every node the split needs before
+      // changing anything, so nothing after this point can throw
+      Key_type separator(leaf->elements[Fanout / 2].first);
+      Spare_nodes spare;
+      spare.leaf = new_leaf();
+      for (size_t n = splits_needed(path, depth); spare.count < n;) {
+        spare.inners[spare.count++] = new_inner();
+      }
+      Leaf *right = split_leaf(leaf, spare.take_leaf());
+      insert_separator(path, path_index, depth, std::move(separator), right,
+                       spare);
+      if (pos > leaf->count) {
+        pos -= leaf->count;
+        leaf = right;
+      }
+    }
+
+    std::move_backward(leaf->elements + pos, leaf->elements + leaf->count,
+                       leaf->elements + leaf->count + 1);
+    leaf->elements[pos] = std::move(element);
+    ++leaf->count;
+    ++num_elements;
+    return {Iterator(leaf, pos), true};
+  }
+
+  // MODIFIES: this
+  // EFFECTS : Removes every element.
+  void clear() {
+    destroy_node(root);
+    root = nullptr;
+    first_leaf = nullptr;
+    num_elements = 0;
+  }
+
+  // EFFECTS : Returns an Iterator to the first key-value pair.
+  Iterator begin() const {
+    return Iterator(first_leaf && first_leaf->count ? first_leaf : nullptr,
+                    0);
+  }
+
+  // EFFECTS : Returns an Iterator to "past-the-end".
+  Iterator end() const {
+    return Iterator();
+  }
+
+  // EFFECTS : Returns the number of bytes used by this BTreeMap's nodes.
+  size_t memory_usage() const {
+    return memory_usage_node(root);
+  }
+
+private:
+  // More levels than this would need more than Fanout^40 elements
+  static const size_t max_depth = 40;
+
+  Node *root;
+  Leaf *first_leaf;
+  size_t num_elements;
+  Key_compare less;
+
+  // Nodes allocated for a split before it starts. Frees any that the
+  // split does not take.
+  struct Spare_nodes {
+    Leaf *leaf = nullptr;
+    Inner *inners[max_depth + 1];
+    size_t count = 0;
+
+    Spare_nodes() = default;
+    Spare_nodes(const Spare_nodes &other) = delete;
+    Spare_nodes &operator=(const Spare_nodes &rhs) = delete;
+
+    ~Spare_nodes() {
+      delete leaf;
+      while (count > 0) {
+        delete inners[--count];
+      }
+    }
+
+    Leaf *take_leaf() {
+      Leaf *taken = leaf;
+      leaf = nullptr;
+      return taken;
+    }
+
+    Inner *take_inner() {
+      assert(count > 0);
+      return inners[--count];
+    }
+  };
+
+  // EFFECTS: Returns the index of the child of 'inner' whose subtree would
+  //          hold key k.
+  template <typename K>
+  size_t child_index(const Inner *inner, const K &k) const {
+    const Key_type *keys = inner->keys;
+    return static_cast<size_t>(
+      std::upper_bound(keys, keys + inner->count, k,
+                       [this](const K &a, const Key_type &b) {
+                         return less(a, b);
+                       }) - keys);
+  }
+
+  // EFFECTS: Returns the index of the first element of 'leaf' whose key is
+  //          not less than k.
+  template <typename K>
+  size_t element_index(const Leaf *leaf, const K &k) const {
+    const Pair_type *elements = leaf->elements;
+    return static_cast<size_t>(
+      std::lower_bound(elements, elements + leaf->count, k,
+                       [this](const Pair_type &a, const K &b) {
+                         return less(a.first, b);
+                       }) - elements);
+  }
+
+  template <typename K>
+  Iterator find_key(const K &k) const {
+    if (!root) {
+      return end();
+    }
+    const Node *node = root;
+    while (!node->is_leaf) {
+      const Inner *inner = static_cast<const Inner *>(node);
+      node = inner->children[child_index(inner, k)];
+    }
+    Leaf *leaf = static_cast<Leaf *>(const_cast<Node *>(node));
+    size_t pos = element_index(leaf, k);
+    if (pos < leaf->count && !less(k, leaf->elements[pos].first)) {
+      return Iterator(leaf, pos);
+    }
+    return end();
+  }
+
+  static Leaf *new_leaf() {
+    Leaf *leaf = new Leaf();
+    leaf->is_leaf = true;
+    leaf->count = 0;
+    leaf->next = nullptr;
+    return leaf;
+  }
+
+  static Inner *new_inner() {
+    Inner *inner = new Inner();
+    inner->is_leaf = false;
+    inner->count = 0;
+    return inner;
+  }
+
+  // EFFECTS: Returns how many inner nodes splitting the leaf at the bottom
+  //          of 'path' creates: one for each full node above it, and a
+  //          new root if they are all full.
+  static size_t splits_needed(Inner *const *path, size_t depth) {
+    size_t full = 0;
+    while (full < depth && path[depth - 1 - full]->count == Fanout - 1) {
+      ++full;
+    }
+    return full == depth ? full + 1 : full;
+  }
+
+  // REQUIRES: 'leaf' is full and 'right' is a new, empty leaf
+  // MODIFIES: 'leaf', 'right'
+  // EFFECTS : Moves the upper half of 'leaf' into 'right', links 'right'
+  //           after it, and returns 'right'.
+  static Leaf *split_leaf(Leaf *leaf, Leaf *right) {
+    size_t keep = leaf->count / 2;
+    std::move(leaf->elements + keep, leaf->elements + leaf->count,
+              right->elements);
+    right->count = leaf->count - keep;
+    leaf->count = keep;
+    right->next = leaf->next;
+    leaf->next = right;
+    return right;
+  }
+
+  // REQUIRES: 'spare' holds splits_needed(path, depth) inner nodes
+  // MODIFIES: this, 'spare'
+  // EFFECTS : After the node at the bottom of 'path' split, inserts
+  //           'separator' and the new right node into its parent,
+  //           splitting inner nodes up the path as needed, and growing a
+  //           new root if the old one split. Takes the new inner nodes
+  //           from 'spare', so nothing here allocates or throws.
+  void insert_separator(Inner **path, size_t *path_index, size_t depth,
+                        Key_type &&separator, Node *right,
+                        Spare_nodes &spare) {
+    while (depth > 0) {
+      --depth;
+      Inner *inner = path[depth];
+      size_t i = path_index[depth];
+      if (inner->count < Fanout - 1) {
+        insert_into_inner(inner, i, std::move(separator), right);
+        return;
+      }
+
+      // Split a full inner node. Number its keys and children as if the
+      // new ones were already in place, keep the lower half, move the
+      // upper half to a sibling and push the middle key up.
+      auto key = [&](size_t j) -> Key_type & {
+        return j < i ? inner->keys[j] : j == i ? separator : inner->keys[j - 1];
+      };
+      Node *children[Fanout + 1];
+      std::copy(inner->children, inner->children + i + 1, children);
+      children[i + 1] = right;
+      std::copy(inner->children + i + 1, inner->children + inner->count + 1,
+                children + i + 2);
+
+      size_t total = inner->count + 1;
+      size_t keep = total / 2;
+      Inner *sibling = spare.take_inner();
+      sibling->count = total - keep - 1;
+      for (size_t j = keep + 1; j < total; ++j) {
+        sibling->keys[j - keep - 1] = std::move(key(j));
+      }
+      std::copy(children + keep + 1, children + total + 1,
+                sibling->children);
+      Key_type middle(std::move(key(keep)));
+      if (i < keep) {
+        std::move_backward(inner->keys + i, inner->keys + keep - 1,
+                           inner->keys + keep);
+        inner->keys[i] = std::move(separator);
+      }
+      inner->count = keep;
+      std::copy(children, children + keep + 1, inner->children);
+
+      separator = std::move(middle);
+      right = sibling;
+    }
+
+    Inner *new_root = spare.take_inner();
+    new_root->count = 1;
+    new_root->keys[0] = std::move(separator);
+    new_root->children[0] = root;
+    new_root->children[1] = right;
+    root = new_root;
+  }
+
+  // REQUIRES: 'inner' is not full
+  // MODIFIES: 'inner'
+  // EFFECTS : Inserts 'key' at position i and 'child' just after it.
+  static void insert_into_inner(Inner *inner, size_t i, Key_type &&key,
+                                Node *child) {
+    std::move_backward(inner->keys + i, inner->keys + inner->count,
+                       inner->keys + inner->count + 1);
+    std::copy_backward(inner->children + i + 1,
+                       inner->children + inner->count + 1,
+                       inner->children + inner->count + 2);
+    inner->keys[i] = std::move(key);
+    inner->children[i + 1] = child;
+    ++inner->count;
+  }
+
+  // EFFECTS: Returns a copy of the subtree rooted at 'node'. Leaves are
+  //          linked after 'last_leaf' in order, and 'last_leaf' is updated
+  //          to the last one copied. If copying an element throws, frees
+  //          the part of the subtree copied so far.
+  // NOTE:    Recursion depth is the height of the B-tree, which stays
+  //          tiny (log base Fanout/2 of the size).
+  Node *copy_node(const Node *node, Leaf *&last_leaf) {
+    if (!node) {
+      return nullptr;
+    }
+    if (node->is_leaf) {
+      const Leaf *leaf = static_cast<const Leaf *>(node);
+      Leaf *copy = new_leaf();
+      try {
+        std::copy(leaf->elements, leaf->elements + leaf->count,
+                  copy->elements);
+      }
+      catch (...) {
+        delete copy;
+        throw;
+      }
+      copy->count = leaf->count;
+      if (last_leaf) {
+        last_leaf->next = copy;
+      }
+      else {
+        first_leaf = copy;
+      }
+      last_leaf = copy;
+      return copy;
+    }
+    const Inner *inner = static_cast<const Inner *>(node);
+    // Children not copied yet stay null, so destroy_node can free a
+    // partial copy
+    Inner *copy = new_inner();
+    copy->count = inner->count;
+    try {
+      std::copy(inner->keys, inner->keys + inner->count, copy->keys);
+      for (size_t i = 0; i <= inner->count; ++i) {
+        copy->children[i] = copy_node(inner->children[i], last_leaf);
+      }
+    }
+    catch (...) {
+      destroy_node(copy);
+      throw;
+    }
+    return copy;
+  }
+
+  // EFFECTS: Frees every node in the subtree rooted at 'node'.
+  // NOTE:    Recursion depth is the height of the B-tree.
+  static void destroy_node(Node *node) {
+    if (!node) {
+      return;
+    }
+    if (node->is_leaf) {
+      delete static_cast<Leaf *>(node);
+      return;
+    }
+    Inner *inner = static_cast<Inner *>(node);
+    for (size_t i = 0; i <= inner->count; ++i) {
+      destroy_node(inner->children[i]);
+    }
+    delete inner;
+  }
+
+  static size_t memory_usage_node(const Node *node) {
+    if (!node) {
+      return 0;
+    }
+    if (node->is_leaf) {
+      return sizeof(Leaf);
+    }
+    const Inner *inner = static_cast<const Inner *>(node);
+    size_t total = sizeof(Inner);
+    for (size_t i = 0; i <= inner->count; ++i) {
+      total += memory_usage_node(inner->children[i]);
+    }
+    return total;
+  }
+};
+
+#endif // BTREE_MAP_HPP
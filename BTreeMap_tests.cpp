@@ -0,0 +1,281 @@
+#include "BTreeMap.hpp"
+#include "unit_test_framework.hpp"
+#include <map>
+#include <new>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+TEST(btree_ctor) {
+    BTreeMap<std::string, int> map;
+    ASSERT_EQUAL(map.begin(), map.end());
+    ASSERT_EQUAL(map.size(), 0);
+    ASSERT_TRUE(map.empty());
+    ASSERT_FALSE(map.contains("a"));
+}
+
+TEST(btree_insert_index) {
+    BTreeMap<std::string, int> map;
+    ASSERT_TRUE(map.insert(std::pair{"test", 5}).second);
+    ASSERT_TRUE(map.insert(std::pair{"hello", 7}).second);
+    auto res = map.insert(std::pair{"hello", 3});
+    ASSERT_FALSE(res.second);
+    ASSERT_EQUAL(res.first->second, 7);
+
+    map["zed"] += 2;
+    map["zed"] += 2;
+    ASSERT_EQUAL(map.size(), 3);
+    ASSERT_EQUAL(map.find("zed")->second, 4);
+    ASSERT_EQUAL(map.count("nope"), 0);
+    ASSERT_EQUAL(map.find("nope"), map.end());
+
+    auto it = map.begin();
+    ASSERT_EQUAL(it->first, "hello");
+    ASSERT_EQUAL((++it)->first, "test");
+    ASSERT_EQUAL((++it)->first, "zed");
+    ASSERT_EQUAL(++it, map.end());
+}
+
+// Small fanout so the test splits leaves and inner nodes many times over
+TEST(btree_matches_std_map) {
+    BTreeMap<int, int, std::less<int>, 4> map;
+    std::map<int, int> expected;
+    std::mt19937 gen(280);
+    std::uniform_int_distribution<int> dist(0, 4999);
+    for (int i = 0; i < 20000; ++i) {
+        int k = dist(gen);
+        auto res = map.try_emplace(k, i);
+        ASSERT_EQUAL(res.second, expected.emplace(k, i).second);
+        ASSERT_EQUAL(res.first->first, k);
+    }
+    ASSERT_EQUAL(map.size(), expected.size());
+
+    auto it = map.begin();
+    for (const auto &kv : expected) {
+        ASSERT_EQUAL(it->first, kv.first);
+        ASSERT_EQUAL(it->second, kv.second);
+        ++it;
+    }
+    ASSERT_EQUAL(it, map.end());
+
+    for (int k = -1; k <= 5000; ++k) {
+        ASSERT_EQUAL(map.count(k), expected.count(k));
+    }
+}
+
+TEST(btree_copy_move_clear) {
+    BTreeMap<int, int, std::less<int>, 5> map;
+    for (int i = 0; i < 500; ++i) {
+        map[i] = i * i;
+    }
+
+    BTreeMap<int, int, std::less<int>, 5> copy(map);
+    copy[7] = -1;
+    ASSERT_EQUAL(map[7], 49);
+    ASSERT_EQUAL(copy.size(), 500);
+    int expected = 0;
+    for (auto &kv : copy) {
+        ASSERT_EQUAL(kv.first, expected++);
+    }
+    ASSERT_EQUAL(expected, 500);
+
+    BTreeMap<int, int, std::less<int>, 5> moved(std::move(copy));
+    ASSERT_EQUAL(moved.size(), 500);
+    ASSERT_TRUE(copy.empty());
+    ASSERT_EQUAL(copy.begin(), copy.end());
+
+    map = moved;
+    ASSERT_EQUAL(map[7], -1);
+
+    map.clear();
+    ASSERT_TRUE(map.empty());
+    ASSERT_EQUAL(map.begin(), map.end());
+    map[3] = 3;
+    ASSERT_EQUAL(map.begin()->second, 3);
+}
+
+TEST(btree_transparent_lookup) {
+    BTreeMap<std::string, int, std::less<>> map;
+    map[std::string_view("apple")] = 1;
+    map["banana"] = 2;
+    std::string_view key = "apple";
+    ASSERT_TRUE(map.contains(key));
+    ASSERT_EQUAL(map.find(key)->second, 1);
+    ASSERT_EQUAL(map.count(std::string_view("cherry")), 0);
+    ASSERT_EQUAL(map.size(), 2);
+}
+
+// A value whose constructor throws when given a negative number
+struct Picky {
+    int value = 0;
+
+    Picky() = default;
+
+    explicit Picky(int value_in) : value(value_in) {
+        if (value < 0) {
+            throw std::invalid_argument("negative");
+        }
+    }
+};
+
+TEST(btree_throwing_value) {
+    BTreeMap<int, Picky> map;
+    for (int i = 0; i < 64; i += 2) {
+        map.try_emplace(i, i);
+    }
+
+    // A failed insertion into the middle of a leaf leaves it as it was
+    for (int k = 1; k < 64; k += 2) {
+        bool threw = false;
+        try {
+            map.try_emplace(k, -1);
+        }
+        catch (const std::invalid_argument &) {
+            threw = true;
+        }
+        ASSERT_TRUE(threw);
+        ASSERT_EQUAL(map.size(), 32);
+        ASSERT_FALSE(map.contains(k));
+    }
+    int expected = 0;
+    for (const auto &kv : map) {
+        ASSERT_EQUAL(kv.first, expected);
+        ASSERT_EQUAL(kv.second.value, expected);
+        expected += 2;
+    }
+    ASSERT_EQUAL(expected, 64);
+
+    // And so does one into a full leaf, which would have to split
+    BTreeMap<int, Picky, std::less<int>, 4> full;
+    for (int i = 0; i < 8; i += 2) {
+        full.try_emplace(i, i);
+    }
+    size_t bytes = full.memory_usage();
+    bool threw = false;
+    try {
+        full.try_emplace(3, -1);
+    }
+    catch (const std::invalid_argument &) {
+        threw = true;
+    }
+    ASSERT_TRUE(threw);
+    ASSERT_EQUAL(full.memory_usage(), bytes);
+    expected = 0;
+    for (const auto &kv : full) {
+        ASSERT_EQUAL(kv.second.value, expected);
+        expected += 2;
+    }
+    ASSERT_EQUAL(expected, 8);
+}
+
+// A key whose copies and default constructions throw once 'budget' of
+// them have been made, the way copying a string throws when memory runs
+// out. A negative budget never runs out.
+struct Fragile {
+    static int budget;
+
+    int value = 0;
+
+    Fragile() {
+        spend();
+    }
+
+    explicit Fragile(int value_in) : value(value_in) { }
+
+    Fragile(const Fragile &other) : value(other.value) {
+        spend();
+    }
+
+    Fragile(Fragile &&other) noexcept = default;
+    Fragile &operator=(const Fragile &rhs) = default;
+    Fragile &operator=(Fragile &&rhs) noexcept = default;
+
+    static void spend() {
+        if (budget == 0) {
+            throw std::bad_alloc();
+        }
+        if (budget > 0) {
+            --budget;
+        }
+    }
+
+    bool operator<(const Fragile &rhs) const {
+        return value < rhs.value;
+    }
+};
+
+int Fragile::budget = -1;
+
+TEST(btree_throwing_split) {
+    // Fanout 4 makes most insertions split a leaf, and many of them split
+    // inner nodes all the way up to a new root
+    BTreeMap<Fragile, int, std::less<Fragile>, 4> map;
+    std::set<int> expected;
+    for (int i = 0; i < 200; i += 2) {
+        map.try_emplace(Fragile(i), i);
+        expected.insert(i);
+    }
+
+    // Every insertion fails at each point it can throw before it
+    // succeeds, and each failure leaves the map as it was
+    for (int k = 1; k < 200; k += 2) {
+        for (int budget = 0; ; ++budget) {
+            size_t bytes = map.memory_usage();
+            Fragile::budget = budget;
+            bool threw = false;
+            try {
+                map.try_emplace(Fragile(k), k);
+            }
+            catch (const std::bad_alloc &) {
+                threw = true;
+            }
+            Fragile::budget = -1;
+            if (!threw) {
+                break;
+            }
+            ASSERT_EQUAL(map.memory_usage(), bytes);
+            ASSERT_EQUAL(map.size(), expected.size());
+            ASSERT_FALSE(map.contains(Fragile(k)));
+        }
+        expected.insert(k);
+        auto it = expected.begin();
+        for (const auto &kv : map) {
+            ASSERT_EQUAL(kv.first.value, *it);
+            ASSERT_EQUAL(kv.second, *it);
+            ++it;
+        }
+        ASSERT_TRUE(it == expected.end());
+    }
+
+    // A copy that fails partway frees what it copied (the leak checker
+    // catches it if not)
+    for (int budget = 0; ; budget += 7) {
+        Fragile::budget = budget;
+        bool threw = false;
+        try {
+            BTreeMap<Fragile, int, std::less<Fragile>, 4> copy(map);
+            ASSERT_EQUAL(copy.size(), 200);
+        }
+        catch (const std::bad_alloc &) {
+            threw = true;
+        }
+        Fragile::budget = -1;
+        if (!threw) {
+            break;
+        }
+    }
+}
+
+TEST(btree_memory_per_entry) {
+    BTreeMap<int, int> map;
+    for (int i = 0; i < 10000; ++i) {
+        map[i] = i;
+    }
+    // Splits leave nodes at least half full
+    ASSERT_TRUE(map.memory_usage() < 10000 * 2 * (sizeof(std::pair<int, int>)
+                                                  + sizeof(void *)));
+}
+
+TEST_MAIN()
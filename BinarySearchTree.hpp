@@ -18,12 +18,198 @@
 #include <cassert>  //assert
 #include <iostream> //ostream
 #include <functional> //less
+#include <algorithm> //max
+#include <type_traits> //is_same_v
+#include <memory> //allocator, allocator_traits
+#include <utility> //forward, move
+#include <iterator> //distance, next, reverse_iterator
+#include <cstddef> //ptrdiff_t
+#include <cstdint> //uint32_t
+#include <stdexcept> //length_error
+#include <future> //async, future
+#include <thread> //hardware_concurrency
+#include <string> //string
+#include <string_view> //string_view
+#include <random> //minstd_rand
+#include <vector> //vector
 
 // You may add aditional libraries here if needed. You may use any
 // part of the STL except for containers.
 
+// What serialize(), deserialize() and freeze() use, declared here so the
+// tree does not depend on those headers. Include Serialize.hpp to call
+// serialize() or deserialize(), and FrozenTree.hpp to call freeze().
+template <typename T, typename ForwardIt>
+void serialize_range(std::ostream &os, ForwardIt first, ForwardIt last,
+                     std::uint64_t count);
+inline std::string serial_read_image(std::istream &is);
+template <typename T> class SerialView;
+template <typename T, typename Compare> class FrozenTree;
+
+// Balancing policies for BinarySearchTree, selected by the third
+// template argument.
+//
+// NoBalance:  Plain BST insertion. The shape of the tree depends on the
+//             order elements are inserted in, so sorted input produces
+//             a tree whose height equals its size.
+// AvlBalance: The tree is rebalanced with AVL rotations after every
+//             insertion and removal, so the heights of the two subtrees of any node
+//             differ by at most one and the height of the whole tree
+//             stays below 1.44 * log2(n + 2).
+// SplayBalance: Self-adjusting. Every find, contains, lower_bound and
+//             insertion (and so every Map operator[], insert and
+//             try_emplace) splays the node it reaches to the root, so
+//             elements that are looked up often stay near the top. Any
+//             sequence of m operations takes O(m log n) amortized time,
+//             and a skewed access pattern costs about the entropy of its
+//             distribution per lookup. Lookups change the shape of the
+//             tree, so even const lookups must not run in several
+//             threads at once.
+struct NoBalance { };
+struct AvlBalance { };
+struct SplayBalance { };
+
+// Tag telling a bulk constructor or assign() that its input range is
+// already in strictly increasing order, so the check can be skipped:
+//   BinarySearchTree<int> tree(sorted_unique, v.begin(), v.end());
+struct SortedUnique { };
+inline constexpr SortedUnique sorted_unique { };
+
+// Says whether a BinarySearchTree of T ordered by Compare keeps a prefix
+// of each element in its node. of() packs the first 8 bytes of a key
+// big-endian into an integer, padding short keys with zeros, so two
+// prefixes that differ order their keys the same way the strings do, and
+// most comparisons made during a search are a single integer compare.
+// Only equal prefixes fall back to Compare. Enabled for std::string with
+// std::less<std::string> or std::less<> (whose queries must then convert
+// to std::string_view). A comparator that orders elements by some key
+// inside them can pass that key's prefix on by defining a nested Prefix
+// with the same two members, as Map's does.
+template <typename T, typename Compare, typename = void>
+struct Key_prefix {
+  static constexpr bool enabled = false;
+};
+
+template <typename Compare>
+struct Key_prefix<std::string, Compare,
+                  std::enable_if_t<std::is_same_v<Compare,
+                                                  std::less<std::string>>
+                                   || std::is_same_v<Compare, std::less<>>>> {
+  static constexpr bool enabled = true;
+
+  static std::uint64_t of(std::string_view key) {
+    std::uint64_t prefix = 0;
+    for (size_t i = 0; i < 8; ++i) {
+      unsigned char byte = i < key.size() ? key[i] : 0;
+      prefix = prefix << 8 | byte;
+    }
+    return prefix;
+  }
+};
+
+template <typename T, typename Compare>
+struct Key_prefix<T, Compare, std::void_t<typename Compare::Prefix>>
+  : Compare::Prefix { };
+
+// The member a Node has when it caches a prefix, and the empty base it
+// has otherwise
+struct Cached_prefix {
+  std::uint64_t prefix;
+};
+struct No_prefix { };
+
+// Says whether a BinarySearchTree whose nodes come from Allocator links
+// them by 32-bit index (see Index_link) and keeps each node's cached
+// height and size in 32 bits apiece, instead of by pointer and in an int
+// and a size_t. That makes every node 20 bytes smaller. An allocator opts
+// in by declaring
+//   using packs_nodes = std::true_type;
+// and the two static functions Index_link uses, as the NodePoolAllocator
+// in NodePool.hpp does. This promises that it never hands out more than
+// 2^32 - 1 nodes at once, and never names one by the index 2^32 - 1. The trees of other allocators
+// are limited only by the allocator.
+template <typename Allocator, typename = void>
+struct Packed_nodes : std::false_type { };
+
+template <typename Allocator>
+struct Packed_nodes<Allocator, std::void_t<typename Allocator::packs_nodes>>
+  : Allocator::packs_nodes { };
+
+// A link from one node to another, stored as the 32-bit index its
+// allocator gives the node it points to. It converts to and from Node *,
+// so code that walks a tree reads the same with either kind of link.
+// Allocator maps between nodes and indices with
+//   static std::uint32_t index_of(const void *node);
+//   static void *address_near(const void *node, std::uint32_t index);
+// where address_near returns the node named by 'index' among those
+// allocated alongside 'node'. A link finds its target through its own
+// address, so it must live inside a node from the same allocator, and it
+// cannot be copied out into a variable; convert it to a Node * instead.
+template <typename Node, typename Allocator>
+class Index_link {
+public:
+  Index_link()
+    : index(null_index) { }
+
+  explicit Index_link(Node *node)
+    : index(index_of(node)) { }
+
+  Index_link(const Index_link &other) = delete;
+
+  Index_link &operator=(const Index_link &rhs) {
+    index = index_of(rhs);
+    return *this;
+  }
+
+  Index_link &operator=(Node *node) {
+    index = index_of(node);
+    return *this;
+  }
+
+  operator Node *() const {
+    if (index == null_index) {
+      return nullptr;
+    }
+    return static_cast<Node *>(Allocator::address_near(this, index));
+  }
+
+  Node *operator->() const {
+    return *this;
+  }
+
+private:
+  // The index of a null link
+  static const std::uint32_t null_index = UINT32_MAX;
+
+  std::uint32_t index;
+
+  static std::uint32_t index_of(const Node *node) {
+    return node ? Allocator::index_of(node) : null_index;
+  }
+};
+
+// Counts of the work a BinarySearchTree has done, kept only when the
+// program is compiled with -DBST_INSTRUMENTATION. Without it, nothing is
+// counted and the trees have no stats() member, so there is no cost.
+//
+// comparisons: calls to the comparator
+// searches:    walks from the root looking for an element or its place
+// node_visits: nodes those walks stepped through; node_visits / searches
+//              is the average search path length
+// allocations: nodes allocated
+// rotations:   rotations done to rebalance the tree
+struct TreeStats {
+  size_t comparisons = 0;
+  size_t searches = 0;
+  size_t node_visits = 0;
+  size_t allocations = 0;
+  size_t rotations = 0;
+};
+
 template <typename T,
-          typename Compare=std::less<T> // default if argument isn't provided
+          typename Compare=std::less<T>, // default if argument isn't provided
+          typename Balance=NoBalance,
+          typename Allocator=std::allocator<T>
          >
 class BinarySearchTree {
 
@@ -32,6 +218,11 @@ class BinarySearchTree {
   // between elements. The default is std::less<T>, which orders
   // according to the < operator on T. (For simplicity, we assume only
   // comparators that can be default constructed will be used.)
+  //
+  // Nodes are obtained from Allocator, which may be any
+  // std::allocator-compatible type for T: std::allocator (the default),
+  // std::pmr::polymorphic_allocator, the ArenaAllocator in Arena.hpp,
+  // or the NodePoolAllocator in NodePool.hpp.
 
   // INVARIANTS: All these invariants must hold for valid implementations
   // of BinarySearchTree. The invariants may also be considered as an implicit
@@ -61,51 +252,255 @@ class BinarySearchTree {
   // "greater than" end up meaning the same thing when duplicates are
   // not allowed.
 
-  // NOTE: Any operation you define must use RECURSION rather than iteration.
-  //       You may NOT use any looping constructs.
+  // NOTE: Copying a tree copies every node, which takes O(n) time. A
+  //       node points back to its parent and is relinked in place, so
+  //       two trees cannot share nodes. For O(1) snapshots that share
+  //       structure, use PersistentTree (PersistentTree.hpp) instead.
+
+  // NOTE: None of the operations recurse, so a degenerate tree (such as
+  //       one built from sorted input with NoBalance) cannot overflow the
+  //       call stack. Walks use loops and the nodes' parent pointers
+  //       instead of an explicit stack. The one exception is the set
+  //       operations (union_with and friends), which only work on AVL
+  //       trees and recurse no deeper than such a tree is tall.
 
 private:
 
-  // A Node stores an element and pointers to its left and right children
-  // DO NOT change this struct definition.
-  struct Node {
+  // A Node stores an element, links to its left and right children
+  // and to its parent, and the height and size of the subtree rooted at
+  // the node. The root's parent link is null. When Packed_nodes is true
+  // for Allocator, the links are 32-bit indices and the height and size
+  // are 32 bits each, so a node's links and counts take 20 bytes instead
+  // of 40. When Key_prefix is enabled for T and Compare, a node also
+  // caches the prefix of its element.
+  using Prefix = Key_prefix<T, Compare>;
+  static constexpr bool packed = Packed_nodes<Allocator>::value;
+  struct Node;
+  using Link = std::conditional_t<packed, Index_link<Node, Allocator>, Node *>;
+  using Height_type = std::conditional_t<packed, std::uint32_t, int>;
+  using Size_type = std::conditional_t<packed, std::uint32_t, size_t>;
+
+  struct Node : std::conditional_t<Prefix::enabled, Cached_prefix, No_prefix> {
 
     // Default constructor - does nothing
     Node() {}
 
     // Custom constructor provided for convenience
     Node(const T &datum_in, Node *left_in, Node *right_in)
-            : datum(datum_in), left(left_in), right(right_in) { }
+            : datum(datum_in), left(left_in), right(right_in),
+              parent(nullptr),
+              height(static_cast<Height_type>(
+                1 + std::max(height_impl(left_in), height_impl(right_in)))),
+              size(static_cast<Size_type>(
+                1 + size_impl(left_in) + size_impl(right_in))) {
+      cache_prefix();
+    }
+
+    // Constructs a leaf whose element is built in place from 'args'
+    template <typename... Args>
+    explicit Node(std::in_place_t, Args &&... args)
+            : datum(std::forward<Args>(args)...), left(nullptr),
+              right(nullptr), parent(nullptr), height(1), size(1) {
+      cache_prefix();
+    }
+
+    void cache_prefix() {
+      if constexpr (Prefix::enabled) {
+        this->prefix = Prefix::of(datum);
+      }
+    }
 
     T datum;
-    Node *left;
-    Node *right;
+    Link left;
+    Link right;
+    Link parent;
+    Height_type height;
+    Size_type size;
   };
 
+  // The allocator type actually used for nodes, and its traits
+  using NodeAlloc = typename std::allocator_traits<Allocator>
+                      ::template rebind_alloc<Node>;
+  using NodeTraits = std::allocator_traits<NodeAlloc>;
+
+#ifdef BST_INSTRUMENTATION
+  // Compare, also counting each call in the stats of the tree it belongs
+  // to. The static helpers below receive it as their 'less' parameter.
+  class Comparator {
+  public:
+    explicit Comparator(TreeStats *stats_in)
+      : stats(stats_in) { }
+
+    template <typename A, typename B>
+    bool operator()(const A &a, const B &b) const {
+      ++stats->comparisons;
+      return compare(a, b);
+    }
+
+    TreeStats *stats;
+    Compare compare;
+  };
+#else
+  using Comparator = Compare;
+#endif
+
 public:
 
   // Default constructor
-  // (Note this will default construct the less comparator)
+  // (Note this will default construct the less comparator and allocator)
   BinarySearchTree()
     : root(nullptr) { }
 
+  // Constructs an empty tree that allocates its nodes from 'alloc_in'
+  explicit BinarySearchTree(const Allocator &alloc_in)
+    : root(nullptr), alloc(alloc_in) { }
+
+  // Range constructor
+  // (Note this builds a perfectly balanced tree in O(n) if the range is
+  // in strictly increasing order; see assign)
+  template <typename ForwardIt>
+  BinarySearchTree(ForwardIt first, ForwardIt last)
+    : root(nullptr) {
+    assign(first, last);
+  }
+
+  // Range constructor for input already known to be sorted
+  template <typename ForwardIt>
+  BinarySearchTree(SortedUnique, ForwardIt first, ForwardIt last)
+    : root(nullptr) {
+    assign(sorted_unique, first, last);
+  }
+
   // Copy constructor
+  // (Note this copies every node of 'other', in O(n) time)
   BinarySearchTree(const BinarySearchTree &other)
-    : root(copy_nodes_impl(other.root)) { }
+    : root(nullptr),
+      alloc(NodeTraits::select_on_container_copy_construction(other.alloc)) {
+    root = copy_nodes_impl(other.root, alloc);
+    count_allocations(size());
+  }
+
+  // Move constructor
+  // (Note this takes over the nodes of 'other', leaving it empty)
+  BinarySearchTree(BinarySearchTree &&other) noexcept
+    : root(other.root), alloc(std::move(other.alloc)) {
+    other.root = nullptr;
+  }
 
   // Assignment operator
+  // (Note this keeps the allocator of this tree)
   BinarySearchTree &operator=(const BinarySearchTree &rhs) {
     if (this == &rhs) {
       return *this;
     }
-    destroy_nodes_impl(root);
-    root = copy_nodes_impl(rhs.root);
+    Node *copy = copy_nodes_impl(rhs.root, alloc);
+    count_allocations(size_impl(copy));
+    destroy_nodes_impl(root, alloc);
+    root = copy;
+    return *this;
+  }
+
+  // Move assignment operator
+  // (Note this takes over the nodes of 'rhs' when the allocators allow it,
+  // and otherwise copies them into this tree's allocator)
+  BinarySearchTree &operator=(BinarySearchTree &&rhs) {
+    if (this == &rhs) {
+      return *this;
+    }
+    destroy_nodes_impl(root, alloc);
+    root = nullptr;
+    if constexpr (NodeTraits::propagate_on_container_move_assignment::value) {
+      alloc = std::move(rhs.alloc);
+    }
+    if (alloc == rhs.alloc) {
+      root = rhs.root;
+      rhs.root = nullptr;
+    }
+    else {
+      root = copy_nodes_impl(rhs.root, alloc);
+      count_allocations(size());
+    }
     return *this;
   }
 
   // Destructor
   ~BinarySearchTree() {
-    destroy_nodes_impl(root);
+    destroy_nodes_impl(root, alloc);
+  }
+
+  // EFFECTS: Returns a copy of the allocator used for this tree's nodes.
+  Allocator get_allocator() const {
+    return Allocator(alloc);
+  }
+
+  // MODIFIES: this BinarySearchTree
+  // EFFECTS : Replaces the contents of this tree with the elements of
+  //           [first, last). If the range is in strictly increasing
+  //           order, builds a perfectly balanced tree in O(n), making
+  //           one allocation per element. Otherwise inserts the elements
+  //           one at a time, keeping the first of any equivalent ones.
+  template <typename ForwardIt>
+  void assign(ForwardIt first, ForwardIt last) {
+    if (is_sorted_unique(first, last)) {
+      assign(sorted_unique, first, last);
+      return;
+    }
+    clear();
+    for (; first != last; ++first) {
+      if (find(*first) == end()) {
+        insert(*first);
+      }
+    }
+  }
+
+  // REQUIRES: [first, last) is in strictly increasing order
+  // MODIFIES: this BinarySearchTree
+  // EFFECTS : Replaces the contents of this tree with a perfectly
+  //           balanced tree holding the elements of [first, last), in
+  //           O(n).
+  template <typename ForwardIt>
+  void assign(SortedUnique, ForwardIt first, ForwardIt last) {
+    size_t count = static_cast<size_t>(std::distance(first, last));
+    check_capacity(count);
+    clear();
+    root = build_sorted_impl(first, count, alloc);
+    count_allocations(size());
+  }
+
+  // REQUIRES: T is supported by Serialize.hpp, which is included
+  // MODIFIES: os
+  // EFFECTS : Writes the elements of this tree to 'os' in order, in the
+  //           compact binary format described in Serialize.hpp. Throws
+  //           serialize_exception if writing fails.
+  void serialize(std::ostream &os) const {
+    serialize_range<T>(os, begin(), end(), size());
+  }
+
+  // REQUIRES: 'is' holds data written by serialize() on a tree with the
+  //           same element type and comparator, and Serialize.hpp is
+  //           included
+  // MODIFIES: this BinarySearchTree, is
+  // EFFECTS : Replaces the contents of this tree with the elements read
+  //           from 'is'. Since they are already sorted, the balanced tree
+  //           is built in O(n) without comparing any elements. Throws
+  //           serialize_exception, leaving this tree unchanged, if the
+  //           data is not a serialized tree of T, is truncated, or has a
+  //           string outside its string pool.
+  void deserialize(std::istream &is) {
+    std::string image = serial_read_image(is);
+    SerialView<T> view(image.data(), image.size());
+    view.check_strings();
+    check_capacity(view.size());
+    clear();
+    root = build_sorted_impl(view.begin(), view.size(), alloc);
+    count_allocations(size());
+  }
+
+  // REQUIRES: FrozenTree.hpp is included
+  // EFFECTS:  Returns an immutable copy of this tree's elements, laid out
+  //           for fast lookups (see FrozenTree.hpp). Takes O(n).
+  FrozenTree<T, Compare> freeze() const {
+    return FrozenTree<T, Compare>(begin(), end());
   }
 
   // EFFECTS: Returns whether this BinarySearchTree is empty.
@@ -118,9 +513,82 @@ public:
     return static_cast<size_t>(height_impl(root));
   }
 
+  // EFFECTS : Returns height() counts, where element d is the number of
+  //           nodes at depth d (the root is at depth 0). Takes O(n).
+  std::vector<size_t> depth_histogram() const {
+    std::vector<size_t> counts(height());
+    if (!counts.empty()) {
+      depth_histogram_impl(root, counts.data());
+    }
+    return counts;
+  }
+
+  // EFFECTS : Returns the average number of nodes a search for an
+  //           element of this tree visits, that is, the average depth
+  //           plus one. Takes O(n).
+  double average_path_length() const {
+    std::vector<size_t> counts = depth_histogram();
+    if (counts.empty()) {
+      return 0;
+    }
+    double total = 0;
+    for (size_t d = 0; d < counts.size(); ++d) {
+      total += static_cast<double>(counts[d]) * (d + 1);
+    }
+    return total / size();
+  }
+
+  // MODIFIES: os
+  // EFFECTS : Prints the size, height, average search path length and
+  //           depth histogram of this tree, and with BST_INSTRUMENTATION
+  //           the counts in stats(), one item per line. Takes O(n).
+  void print_stats(std::ostream &os) const {
+    os << "size " << size() << "\n"
+       << "height " << height() << "\n"
+       << "average path length " << average_path_length() << "\n";
+#ifdef BST_INSTRUMENTATION
+    os << "comparisons " << stats_counts.comparisons << "\n"
+       << "searches " << stats_counts.searches << "\n"
+       << "node visits " << stats_counts.node_visits << "\n"
+       << "allocations " << stats_counts.allocations << "\n"
+       << "rotations " << stats_counts.rotations << "\n";
+#endif
+    std::vector<size_t> counts = depth_histogram();
+    for (size_t d = 0; d < counts.size(); ++d) {
+      os << "depth " << d << ": " << counts[d] << "\n";
+    }
+  }
+
+#ifdef BST_INSTRUMENTATION
+  // EFFECTS : Returns the work counted since this tree was created or
+  //           reset_stats() was last called.
+  const TreeStats &stats() const {
+    return stats_counts;
+  }
+
+  // MODIFIES: this BinarySearchTree
+  // EFFECTS : Sets every count in stats() back to zero.
+  void reset_stats() {
+    stats_counts = TreeStats();
+  }
+#endif
+
   // EFFECTS: Returns the number of elements in this BinarySearchTree.
   size_t size() const {
-    return static_cast<size_t>(size_impl(root));
+    return size_impl(root);
+  }
+
+  // EFFECTS: Returns the largest number of elements a BinarySearchTree
+  //          can hold: what the allocator allows, and with packed counts
+  //          (see Packed_nodes) no more than 2^32 - 1. Inserting past it
+  //          throws std::length_error.
+  size_t max_size() const {
+    if constexpr (packed) {
+      return std::min<size_t>(UINT32_MAX, NodeTraits::max_size(alloc));
+    }
+    else {
+      return NodeTraits::max_size(alloc);
+    }
   }
 
   // EFFECTS: Traverses the tree using an in-order traversal,
@@ -141,22 +609,50 @@ public:
 
   // EFFECTS: Returns whether or not the sorting invariant holds on
   //          the root of this BinarySearchTree.
-  //
-  // NOTE: This function must be recursive.
   bool check_sorting_invariant() const {
     return check_sorting_invariant_impl(root, less);
   }
 
+  // EFFECTS: A cheap, partial version of the check above, cheap enough
+  //          to leave enabled in production builds. Walks from the root
+  //          to 'num_paths' elements chosen at random, checking that each
+  //          node on the way lies between the bounds set by its ancestors
+  //          and that its parent pointer and cached size are consistent.
+  //          Returns false if any check fails. Runs in
+  //          O(num_paths * height); successive calls choose different
+  //          paths.
+  bool check_sorting_invariant(size_t num_paths) const {
+    thread_local std::minstd_rand gen;
+    size_t n = size();
+    for (size_t i = 0; i < num_paths && n > 0; ++i) {
+      if (!check_path_impl(root, gen() % n, less)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
   class Iterator {
     // OVERVIEW: Iterator interface for BinarySearchTree.
     //           Iterates over the elements in ascending order as defined
     //           by the sorted ordering of the BinarySearchTree.
+    //           A bidirectional iterator: each step follows the parent
+    //           and child pointers, which takes O(1) amortized time, and
+    //           stepping back from end() reaches the maximum element.
 
     // Big Three for Iterator not needed
 
   public:
+    // Member types for std::iterator_traits, so that the algorithms in
+    // <algorithm> and std::reverse_iterator accept this iterator
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = T *;
+    using reference = T &;
+
     Iterator()
-      : root(nullptr), current_node(nullptr) {}
+      : current_node(nullptr), tree(nullptr) {}
 
     // EFFECTS:  Returns the current element by reference.
     // WARNING:  Dereferencing an iterator returns an element from the tree
@@ -188,14 +684,7 @@ public:
 
     // Prefix ++
     Iterator &operator++() {
-      if (current_node->right) {
-        // If has right child, next element is minimum of right subtree
-        current_node = min_element_impl(current_node->right);
-      }
-      else {
-        // Otherwise, look in the whole tree for the next biggest element
-        current_node = min_greater_than_impl(root, current_node->datum, less);
-      }
+      current_node = successor_impl(current_node);
       return *this;
     }
 
@@ -206,6 +695,27 @@ public:
       return result;
     }
 
+    // REQUIRES: this Iterator is not the first element of its tree
+    // EFFECTS:  Moves to the previous element; from an end Iterator, moves
+    //           to the maximum element.
+    Iterator &operator--() {
+      if (current_node) {
+        current_node = predecessor_impl(current_node);
+      }
+      else {
+        assert(tree);
+        current_node = max_element_impl(tree->root);
+      }
+      return *this;
+    }
+
+    // Postfix -- (implemented in terms of prefix --)
+    Iterator operator--(int) {
+      Iterator result(*this);
+      --(*this);
+      return result;
+    }
+
     bool operator==(const Iterator &rhs) const {
       return current_node == rhs.current_node;
     }
@@ -217,12 +727,14 @@ public:
   private:
     friend class BinarySearchTree;
 
-    Node *root;
     Node *current_node;
-    Compare less;
 
-    Iterator(Node *root_in, Node* current_node_in, Compare less_in)
-      : root(root_in), current_node(current_node_in), less(less_in) { }
+    // The tree this Iterator belongs to, so that an end Iterator can step
+    // back to the maximum element
+    const BinarySearchTree *tree;
+
+    Iterator(Node* current_node_in, const BinarySearchTree *tree_in)
+      : current_node(current_node_in), tree(tree_in) { }
 
   }; // BinarySearchTree::Iterator
   ////////////////////////////////////////
@@ -232,34 +744,47 @@ public:
   //           in this BinarySearchTree.
   Iterator begin() const {
     if (root == nullptr) {
-      return Iterator();
+      return Iterator(nullptr, this);
     }
-    return Iterator(root, min_element_impl(root), less);
+    return Iterator(min_element_impl(root), this);
   }
 
   // EFFECTS: Returns an iterator to past-the-end.
   Iterator end() const {
-    return Iterator();
+    return Iterator(nullptr, this);
+  }
+
+  // Iterates over the elements in descending order
+  using Reverse_iterator = std::reverse_iterator<Iterator>;
+
+  // EFFECTS: Returns a reverse iterator to the maximum element.
+  Reverse_iterator rbegin() const {
+    return Reverse_iterator(end());
+  }
+
+  // EFFECTS: Returns a reverse iterator to "before-the-beginning".
+  Reverse_iterator rend() const {
+    return Reverse_iterator(begin());
   }
 
 
   // EFFECTS: Returns an Iterator to the minimum element in this
   //          BinarySearchTree or an end Iterator if the tree is empty.
   Iterator min_element() const {
-    return Iterator(root, min_element_impl(root), less);
+    return Iterator(min_element_impl(root), this);
   }
 
   // EFFECTS: Returns an Iterator to the maximum element in this
   //          BinarySearchTree or an end Iterator if the tree is empty.
   Iterator max_element() const {
-    return Iterator(root, max_element_impl(root), less);
+    return Iterator(max_element_impl(root), this);
   }
 
   // EFFECTS: Returns an Iterator to the minimum element in this
   //          BinarySearchTree greater than the given value.
   //          If the tree is empty, returns an end Iterator.
   Iterator min_greater_than(const T &value) const {
-    return Iterator(root, min_greater_than_impl(root, value, less), less);
+    return Iterator(min_greater_than_impl(root, value, less), this);
   }
 
 
@@ -273,7 +798,178 @@ public:
   //          to the existing value. Otherwise, the sorting invariant
   //          will no longer hold.
   Iterator find(const T &query) const {
-    return Iterator(root, find_impl(root, query, less), less);
+    return Iterator(access(query), this);
+  }
+
+  // EFFECTS: Same as above, but 'query' may be of any type the comparator
+  //          can compare with T. Only available when Compare declares
+  //          is_transparent (as std::less<> does), which lets callers
+  //          search without building a T.
+  template <typename K, typename C = Compare,
+            typename = typename C::is_transparent>
+  Iterator find(const K &query) const {
+    return Iterator(access(query), this);
+  }
+
+  // REQUIRES: 'finger' is an Iterator into this tree
+  // EFFECTS : Same as find, but starts the search from 'finger' rather
+  //           than the root: climbs from it only as far as needed to
+  //           reach a subtree that would hold 'query', then searches down.
+  //           Takes O(log d) steps in an AVL tree, where d is how many
+  //           elements lie between 'finger' and 'query', so lookups near
+  //           the previous one are cheap.
+  Iterator find_from(Iterator finger, const T &query) const {
+    return Iterator(find_from_impl(finger.current_node, root, query, less),
+                    this);
+  }
+
+  // EFFECTS: Same as above, for a transparent comparator.
+  template <typename K, typename C = Compare,
+            typename = typename C::is_transparent>
+  Iterator find_from(Iterator finger, const K &query) const {
+    return Iterator(find_from_impl(finger.current_node, root, query, less),
+                    this);
+  }
+
+  // EFFECTS: Returns whether this tree holds an element equivalent to
+  //          'query'.
+  bool contains(const T &query) const {
+    return access(query) != nullptr;
+  }
+
+  // EFFECTS: Same as above, for a transparent comparator.
+  template <typename K, typename C = Compare,
+            typename = typename C::is_transparent>
+  bool contains(const K &query) const {
+    return access(query) != nullptr;
+  }
+
+  // EFFECTS: Returns the number of elements equivalent to 'query'
+  //          (0 or 1).
+  size_t count(const T &query) const {
+    return contains(query) ? 1 : 0;
+  }
+
+  // EFFECTS: Same as above, for a transparent comparator.
+  template <typename K, typename C = Compare,
+            typename = typename C::is_transparent>
+  size_t count(const K &query) const {
+    return contains(query) ? 1 : 0;
+  }
+
+  // EFFECTS: Returns the number of elements in this BinarySearchTree that
+  //          are less than 'query', which is the position 'query' has or
+  //          would have in the sorted order. Runs in O(height).
+  size_t rank(const T &query) const {
+    return rank_impl(root, query, less);
+  }
+
+  // EFFECTS: Same as above, for a transparent comparator.
+  template <typename K, typename C = Compare,
+            typename = typename C::is_transparent>
+  size_t rank(const K &query) const {
+    return rank_impl(root, query, less);
+  }
+
+  // EFFECTS: Returns an Iterator to the element at position 'k' (counting
+  //          from 0) in the sorted order, or an end Iterator if 'k' is not
+  //          less than size(). Runs in O(height).
+  Iterator select(size_t k) const {
+    return Iterator(select_impl(root, k), this);
+  }
+
+  // EFFECTS: Returns the number of elements e in this BinarySearchTree
+  //          with lo <= e < hi. Runs in O(height).
+  size_t count_range(const T &lo, const T &hi) const {
+    return count_between(rank(lo), rank(hi));
+  }
+
+  // EFFECTS: Same as above, for a transparent comparator.
+  template <typename K, typename C = Compare,
+            typename = typename C::is_transparent>
+  size_t count_range(const K &lo, const K &hi) const {
+    return count_between(rank(lo), rank(hi));
+  }
+
+  // EFFECTS: Returns an Iterator to the first element that is not less
+  //          than 'query', or an end Iterator if there is none. Runs in
+  //          O(height). With SplayBalance, splays as find does.
+  Iterator lower_bound(const T &query) const {
+    return Iterator(access_lower_bound(query), this);
+  }
+
+  // EFFECTS: Same as above, for a transparent comparator.
+  template <typename K, typename C = Compare,
+            typename = typename C::is_transparent>
+  Iterator lower_bound(const K &query) const {
+    return Iterator(access_lower_bound(query), this);
+  }
+
+  // EFFECTS: Returns an Iterator to the first element that is greater
+  //          than 'query', or an end Iterator if there is none. Runs in
+  //          O(height).
+  Iterator upper_bound(const T &query) const {
+    return Iterator(min_greater_than_impl(root, query, less), this);
+  }
+
+  // EFFECTS: Same as above, for a transparent comparator.
+  template <typename K, typename C = Compare,
+            typename = typename C::is_transparent>
+  Iterator upper_bound(const K &query) const {
+    return Iterator(min_greater_than_impl(root, query, less), this);
+  }
+
+  // EFFECTS: Returns the range of elements equivalent to 'query', as the
+  //          pair {lower_bound(query), upper_bound(query)}. Since there
+  //          are no duplicates, it holds at most one element.
+  std::pair<Iterator, Iterator> equal_range(const T &query) const {
+    return {lower_bound(query), upper_bound(query)};
+  }
+
+  // EFFECTS: Same as above, for a transparent comparator.
+  template <typename K, typename C = Compare,
+            typename = typename C::is_transparent>
+  std::pair<Iterator, Iterator> equal_range(const K &query) const {
+    return {lower_bound(query), upper_bound(query)};
+  }
+
+  // A pair of Iterators that can be used in a range-based for loop
+  class Range {
+  public:
+    Range(Iterator first_in, Iterator last_in)
+      : first(first_in), last(last_in) { }
+
+    Iterator begin() const {
+      return first;
+    }
+
+    Iterator end() const {
+      return last;
+    }
+
+    bool empty() const {
+      return first == last;
+    }
+
+  private:
+    Iterator first;
+    Iterator last;
+  };
+
+  // EFFECTS: Returns the elements e with lo <= e < hi, in order. Finding
+  //          the ends takes O(height), and iterating visits only the
+  //          elements in the range, so the rest of the tree is never
+  //          touched. For example, the words starting with "valgr" are
+  //          tree.range("valgr", "valgs").
+  Range range(const T &lo, const T &hi) const {
+    return make_range(lower_bound(lo), lower_bound(hi));
+  }
+
+  // EFFECTS: Same as above, for a transparent comparator.
+  template <typename K, typename C = Compare,
+            typename = typename C::is_transparent>
+  Range range(const K &lo, const K &hi) const {
+    return make_range(lower_bound(lo), lower_bound(hi));
   }
 
   // REQUIRES: The given item is not already contained in this BinarySearchTree
@@ -281,39 +977,443 @@ public:
   // EFFECTS : Inserts the element k into this BinarySearchTree, maintaining
   //           the sorting invariant.
   Iterator insert(const T &item) {
-    assert(find(item) == end());
-    root = insert_impl(root, item, less);
-    return find(item);
+    assert(!holds(item));
+    check_capacity(size() + 1);
+    return insert_node(create_node_impl(alloc, item));
+  }
+
+  // REQUIRES: The given item is not already contained in this BinarySearchTree
+  // MODIFIES: this BinarySearchTree
+  // EFFECTS : Inserts the element k into this BinarySearchTree by moving
+  //           it into the new node, maintaining the sorting invariant.
+  Iterator insert(T &&item) {
+    assert(!holds(item));
+    check_capacity(size() + 1);
+    return insert_node(create_node_impl(alloc, std::move(item)));
+  }
+
+  // REQUIRES: The element constructed from 'args' is not already
+  //           contained in this BinarySearchTree
+  // MODIFIES: this BinarySearchTree
+  // EFFECTS : Constructs an element from 'args' directly inside a new
+  //           node and inserts it, maintaining the sorting invariant.
+  //           Returns an Iterator to the new element.
+  template <typename... Args>
+  Iterator emplace(Args &&... args) {
+    check_capacity(size() + 1);
+    Node *leaf = create_node_impl(alloc, std::forward<Args>(args)...);
+    assert(!holds(leaf->datum));
+    return insert_node(leaf);
+  }
+
+  // REQUIRES: The element constructed from 'args' is not already
+  //           contained in this BinarySearchTree, and 'hint' is an
+  //           Iterator into it
+  // MODIFIES: this BinarySearchTree
+  // EFFECTS : Same as emplace, but if the new element belongs right
+  //           before 'hint' (or after the maximum, for an end Iterator),
+  //           links it there after comparing it with just those two
+  //           neighbours instead of searching from the root. Otherwise
+  //           inserts it as emplace does. Returns an Iterator to the new
+  //           element.
+  // NOTE:     Linking still walks up to the root to update the cached
+  //           heights and sizes, but makes no comparisons on the way.
+  //           To insert a sorted stream, pass end() as the hint.
+  template <typename... Args>
+  Iterator emplace_hint(Iterator hint, Args &&... args) {
+    check_capacity(size() + 1);
+    Node *leaf = create_node_impl(alloc, std::forward<Args>(args)...);
+    Node *next = hint.current_node;
+    Node *prev = next ? predecessor_impl(next) : max_element_impl(root);
+    if ((next && !less(leaf->datum, next->datum))
+        || (prev && !less(prev->datum, leaf->datum))) {
+      assert(!holds(leaf->datum));
+      return insert_node(leaf);
+    }
+    count_allocations(1);
+    Rotation_scope rotations(*this);
+    root = insert_between_impl(root, prev, next, leaf);
+    root->parent = nullptr;
+    splay(leaf);
+    return Iterator(leaf, this);
+  }
+
+  // REQUIRES: as for emplace_hint
+  // MODIFIES: this BinarySearchTree
+  // EFFECTS : Inserts a copy of 'item' using 'hint' as emplace_hint does.
+  Iterator insert(Iterator hint, const T &item) {
+    return emplace_hint(hint, item);
+  }
+
+  // REQUIRES: as for emplace_hint
+  // MODIFIES: this BinarySearchTree
+  // EFFECTS : Moves 'item' into the tree using 'hint' as emplace_hint
+  //           does.
+  Iterator insert(Iterator hint, T &&item) {
+    return emplace_hint(hint, std::move(item));
+  }
+
+  // REQUIRES: 'pos' points to an element of this BinarySearchTree
+  // MODIFIES: this BinarySearchTree
+  // EFFECTS : Removes the element at 'pos' and returns an Iterator to the
+  //           element that followed it. Iterators to other elements stay
+  //           valid. Runs in O(height).
+  Iterator erase(Iterator pos) {
+    Rotation_scope rotations(*this);
+    Node *next = successor_impl(pos.current_node);
+    root = erase_impl(root, pos.current_node);
+    free_node_impl(pos.current_node, alloc);
+    return Iterator(next, this);
+  }
+
+  // MODIFIES: this BinarySearchTree
+  // EFFECTS : Removes the element equivalent to 'item', if there is one.
+  //           Returns the number of elements removed (0 or 1).
+  size_t erase(const T &item) {
+    Iterator pos = find(item);
+    if (pos == end()) {
+      return 0;
+    }
+    erase(pos);
+    return 1;
+  }
+
+  // REQUIRES: [first, last) is a valid range of this BinarySearchTree
+  // MODIFIES: this BinarySearchTree
+  // EFFECTS : Removes every element in [first, last) and returns 'last'.
+  Iterator erase(Iterator first, Iterator last) {
+    if (first == begin() && last == end()) {
+      clear();
+      return end();
+    }
+    while (first != last) {
+      first = erase(first);
+    }
+    return last;
+  }
+
+  // MODIFIES: this BinarySearchTree
+  // EFFECTS : Removes every element.
+  void clear() {
+    destroy_nodes_impl(root, alloc);
+    root = nullptr;
+  }
+
+  // The set operations below combine two trees with join and split
+  // instead of inserting one element at a time, taking
+  // O(m log(n/m + 1)) work for trees of sizes m <= n. Large subproblems
+  // are handed to other threads when nodes come from std::allocator.
+  // Every element of 'other' is either moved into this tree or freed, and
+  // 'other' is left empty.
+
+  // REQUIRES: Balance is AvlBalance, 'other' uses an equal allocator and
+  //           'combine' does not throw
+  // MODIFIES: this BinarySearchTree, 'other'
+  // EFFECTS : Moves every element of 'other' into this tree. When both
+  //           trees hold equivalent elements, calls
+  //           combine(mine, std::move(theirs)) and keeps 'mine'. 'combine'
+  //           may be called from several threads at once, on different
+  //           elements. Throws std::length_error, changing neither tree,
+  //           if the sizes of the two trees add up to more than
+  //           max_size().
+  template <typename Combiner>
+  void union_with(BinarySearchTree &&other, Combiner combine) {
+    check_capacity(size() + other.size());
+    root = set_op<SetOp::Union>(other, combine);
+  }
+
+  // REQUIRES: as for union_with
+  // MODIFIES: this BinarySearchTree, 'other'
+  // EFFECTS : Moves every element of 'other' that has no equivalent in
+  //           this tree into it.
+  void merge(BinarySearchTree &&other) {
+    union_with(std::move(other), KeepExisting());
+  }
+
+  // REQUIRES: as for union_with
+  // MODIFIES: this BinarySearchTree, 'other'
+  // EFFECTS : Removes every element that has no equivalent in 'other'.
+  //           For the elements that remain, calls
+  //           combine(mine, std::move(theirs)).
+  template <typename Combiner>
+  void intersection_with(BinarySearchTree &&other, Combiner combine) {
+    root = set_op<SetOp::Intersection>(other, combine);
+  }
+
+  // REQUIRES: as for union_with
+  // MODIFIES: this BinarySearchTree, 'other'
+  // EFFECTS : Removes every element that has no equivalent in 'other'.
+  void intersection_with(BinarySearchTree &&other) {
+    intersection_with(std::move(other), KeepExisting());
+  }
+
+  // REQUIRES: as for union_with
+  // MODIFIES: this BinarySearchTree, 'other'
+  // EFFECTS : Removes every element that has an equivalent in 'other'.
+  void difference_with(BinarySearchTree &&other) {
+    KeepExisting combine;
+    root = set_op<SetOp::Difference>(other, combine);
   }
 
   // EFFECTS: Returns a human-readable string representation of this
-  //          BinarySearchTree. Works best for small trees.
+  //          BinarySearchTree. Works best for small trees; larger ones
+  //          are cut off as print_tree() does with its default limits.
   //
   // NOTE: This member function is implemented for you in TreePrint.hpp.
   //       You may use it, but you don't need to worry about how it works.
   std::string to_string() const;
 
+  // MODIFIES: os
+  // EFFECTS : Draws the top of this tree to 'os' the way to_string()
+  //           does, writing the lines straight to 'os'. Draws at
+  //           most 'max_depth' levels (but always the root), and fewer if
+  //           the lines would be wider than 'max_width' characters. Each
+  //           subtree below the last level drawn appears as "..." in
+  //           place of its root. Only the elements drawn are visited and
+  //           printed, so the time and memory this takes depend on the
+  //           limits and not on the size of the tree, which makes it safe
+  //           for dumping large trees.
+  //
+  // NOTE: This member function is implemented in TreePrint.hpp.
+  void print_tree(std::ostream &os, size_t max_depth = 16,
+                  size_t max_width = 256) const;
+
 
 private:
 
+  // MODIFIES: this BinarySearchTree
+  // REQUIRES: The tree has room for one more element
+  // EFFECTS : Links the detached node 'leaf' into the tree and returns an
+  //           Iterator to it.
+  Iterator insert_node(Node *leaf) {
+    count_allocations(1);
+    Rotation_scope rotations(*this);
+    root = insert_impl(root, leaf, less);
+    root->parent = nullptr;
+    splay(leaf);
+    return Iterator(leaf, this);
+  }
+
+  // EFFECTS : Returns a pointer to the node holding an element equivalent
+  //           to 'query', or a null pointer if there is none. With
+  //           SplayBalance, also splays that node, or the last node the
+  //           search visited if there is none, to the root.
+  template <typename K>
+  Node * access(const K &query) const {
+    if constexpr (std::is_same_v<Balance, SplayBalance>) {
+      bool found = false;
+      Node *last = search_impl(root, query, less, found);
+      if (last) {
+        Rotation_scope rotations(*this);
+        splay(last);
+      }
+      return found ? last : nullptr;
+    }
+    else {
+      return find_impl(root, query, less);
+    }
+  }
+
+  // EFFECTS : Returns a pointer to the node holding the first element not
+  //           less than 'query', or a null pointer if there is none. With
+  //           SplayBalance, also splays the node holding an element
+  //           equivalent to 'query', or the last node the search visited
+  //           if there is none, to the root, as access() does.
+  template <typename K>
+  Node * access_lower_bound(const K &query) const {
+    if constexpr (std::is_same_v<Balance, SplayBalance>) {
+      bool found = false;
+      Node *last = search_impl(root, query, less, found);
+      if (!last) {
+        return nullptr;
+      }
+      // The search fell off 'last' on the side facing 'query', so the
+      // bound is 'last' or, past it, the ancestor it climbs back up to
+      Node *bound = found || less(query, last->datum)
+                      ? last : successor_impl(last);
+      Rotation_scope rotations(*this);
+      splay(last);
+      return bound;
+    }
+    else {
+      return lower_bound_impl(root, query, less);
+    }
+  }
+
+  // EFFECTS : Returns whether an element equivalent to 'query' is in this
+  //           tree. Unlike access(), never splays and is not counted in
+  //           stats(), so the assertions that use it leave the tree the
+  //           same shape in debug and NDEBUG builds.
+  template <typename K>
+  bool holds(const K &query) const {
+#ifdef BST_INSTRUMENTATION
+    TreeStats uncounted;
+    Comparator quiet(&uncounted);
+#else
+    Comparator quiet;
+#endif
+    return find_impl(root, query, quiet) != nullptr;
+  }
+
+  // MODIFIES: root
+  // EFFECTS : With SplayBalance, moves 'node' to the root. Does nothing
+  //           with other policies.
+  void splay(Node *node) const {
+    if constexpr (std::is_same_v<Balance, SplayBalance>) {
+      root = splay_impl(node);
+    }
+    else {
+      (void)node;
+    }
+  }
+
+  // EFFECTS : Throws std::length_error if a tree of 'count' elements
+  //           would not fit in max_size().
+  void check_capacity(size_t count) const {
+    if (count > max_size()) {
+      throw std::length_error("BinarySearchTree: too many elements");
+    }
+  }
+
+  // The set operations share one algorithm, which differs only in what
+  // it keeps
+  enum class SetOp { Union, Intersection, Difference };
+
+  // The combiner used when equivalent elements are simply dropped
+  struct KeepExisting {
+    void operator()(T &, T &&) const { }
+  };
+
+  // Subproblems with fewer elements than this are never forked
+  static const size_t parallel_grain = 4096;
+
+  // MODIFIES: this BinarySearchTree, 'other'
+  // EFFECTS : Runs the set operation 'Op' on this tree and 'other',
+  //           empties 'other', and returns the root of the result.
+  template <SetOp Op, typename Combiner>
+  Node * set_op(BinarySearchTree &other, Combiner &combine) {
+    static_assert(std::is_same_v<Balance, AvlBalance>,
+                  "set operations need AvlBalance trees");
+    assert(alloc == other.alloc);
+    Rotation_scope rotations(*this);
+    Node *other_root = other.root;
+    other.root = nullptr;
+    return set_op_impl<Op>(root, other_root, combine, less, alloc,
+                           fork_depth_impl());
+  }
+
+  // Instrumentation hooks (see TreeStats). Without BST_INSTRUMENTATION
+  // they do nothing and compile away.
+
+  static void count_search(const Comparator &less) {
+#ifdef BST_INSTRUMENTATION
+    ++less.stats->searches;
+#else
+    (void)less;
+#endif
+  }
+
+  static void count_visit(const Comparator &less) {
+#ifdef BST_INSTRUMENTATION
+    ++less.stats->node_visits;
+#else
+    (void)less;
+#endif
+  }
+
+  void count_allocations(size_t n) const {
+#ifdef BST_INSTRUMENTATION
+    stats_counts.allocations += n;
+#else
+    (void)n;
+#endif
+  }
+
+#ifdef BST_INSTRUMENTATION
+  // The rotation helpers have no 'less' to reach a tree's stats through,
+  // so rotations are counted per thread, and a Rotation_scope in the
+  // member function that causes them credits them to the tree
+  static inline thread_local size_t thread_rotations = 0;
+#endif
+
+  static void count_rotation() {
+#ifdef BST_INSTRUMENTATION
+    ++thread_rotations;
+#endif
+  }
+
+  class Rotation_scope {
+  public:
+#ifdef BST_INSTRUMENTATION
+    explicit Rotation_scope(const BinarySearchTree &tree)
+      : stats(tree.stats_counts), start(thread_rotations) { }
+
+    ~Rotation_scope() {
+      stats.rotations += thread_rotations - start;
+    }
+
+  private:
+    TreeStats &stats;
+    size_t start;
+#else
+    explicit Rotation_scope(const BinarySearchTree &) { }
+#endif
+  };
+
+  // EFFECTS : Returns the Range [first, last), or an empty Range if
+  //           'last' comes before 'first' (that is, if hi < lo).
+  Range make_range(Iterator first, Iterator last) const {
+    if (first == end() || (last != end() && less(*last, *first))) {
+      return Range(first, first);
+    }
+    return Range(first, last);
+  }
+
+  // EFFECTS : Returns the number of positions in [rank_lo, rank_hi), or 0
+  //           if the range is empty.
+  static size_t count_between(size_t rank_lo, size_t rank_hi) {
+    return rank_hi > rank_lo ? rank_hi - rank_lo : 0;
+  }
+
+  // EFFECTS : Returns whether [first, last) is in strictly increasing
+  //           order according to the comparator.
+  template <typename ForwardIt>
+  bool is_sorted_unique(ForwardIt first, ForwardIt last) const {
+    if (first == last) {
+      return true;
+    }
+    for (ForwardIt next = std::next(first); next != last; ++first, ++next) {
+      if (!less(*first, *next)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
   // DATA REPRESENTATION
-  // The root node of this BinarySearchTree.
-  Node *root;
+  // The root node of this BinarySearchTree. Lookups in a SplayBalance
+  // tree move the node they reach to the root, so it is mutable.
+  mutable Node *root;
+
+#ifdef BST_INSTRUMENTATION
+  // The counts returned by stats(). Lookups are const but still counted,
+  // so it is mutable.
+  mutable TreeStats stats_counts;
 
+  // An instance of the Compare type. Use this to compare elements.
+  Comparator less {&stats_counts};
+#else
   // An instance of the Compare type. Use this to compare elements.
   Compare less;
+#endif
 
-    
-  // NOTE: These member types are implemented for you in TreePrint.hpp.
-  //       They support the to_string function. You do not have to do
-  //       anything with them. DO NOT CHANGE.
-  class Tree_grid_square;
-  class Tree_grid;
+  // The allocator that nodes are obtained from and returned to.
+  NodeAlloc alloc;
 
-  // NOTE: This member function is implemented for you in TreePrint.hpp.
-  //       It supports the to_string function. You do not have to do
-  //       anything with it. DO NOT CHANGE.
-  int get_max_elt_width() const;
+    
+  // NOTE: This member type is implemented in TreePrint.hpp. It supports
+  //       the to_string and print_tree functions.
+  class Tree_layout;
 
 
 
@@ -336,211 +1436,954 @@ private:
   // EFFECTS: Returns the size of the tree rooted at 'node', which is the
   //          total number of nodes in that tree. The size of an empty
   //          tree is 0.
-  // NOTE:    This function must be tree recursive.
-  static int size_impl(const Node *node) {
+  // NOTE:    Every node caches the size of its subtree, so this function
+  //          runs in constant time.
+  static size_t size_impl(const Node *node) {
     if(!node)
       return 0;
-    return size_impl(node->left) + size_impl(node->right) + 1;
+    return node->size;
   }
 
   // EFFECTS: Returns the height of the tree rooted at 'node', which is the
   //          number of nodes in the longest path from the 'node' to a leaf.
   //          The height of an empty tree is 0.
-  // NOTE:    This function must be tree recursive.
+  // NOTE:    Every node caches the height of its subtree, so this function
+  //          runs in constant time.
   static int height_impl(const Node *node) {
     if(!node) return 0;
-    return 1 + std::max(height_impl(node->left), height_impl(node->right));
+    return static_cast<int>(node->height);
   }
 
   // EFFECTS: Creates and returns a pointer to the root of a new node structure
   //          with the same elements and EXACTLY the same structure as the
   //          tree rooted at 'node'.
-  // NOTE:    This function must be tree recursive.
-  static Node *copy_nodes_impl(Node *node) {
+  // NOTE:    Walks both trees in pre-order in lockstep, climbing back up
+  //          through the parent pointers of the source and the copy.
+  static Node *copy_nodes_impl(Node *node, NodeAlloc &alloc) {
     if(!node) return nullptr;
 
-    Node* temp = new Node();
-    temp->datum = node->datum;
-    temp->left = copy_nodes_impl(node->left);
-    temp->right = copy_nodes_impl(node->right);
-
-    return temp;
+    Node *copy = clone_node_impl(node, alloc);
+    Node *src = node;
+    Node *dst = copy;
+    while(true) {
+      if(src->left && !dst->left) {
+        dst->left = clone_node_impl(src->left, alloc);
+        dst->left->parent = dst;
+        src = src->left;
+        dst = dst->left;
+      }
+      else if(src->right && !dst->right) {
+        dst->right = clone_node_impl(src->right, alloc);
+        dst->right->parent = dst;
+        src = src->right;
+        dst = dst->right;
+      }
+      else if(src == node) {
+        return copy;
+      }
+      else {
+        src = src->parent;
+        dst = dst->parent;
+      }
+    }
   }
 
   // EFFECTS: Frees the memory for all nodes used in the tree rooted at 'node'.
-  // NOTE:    This function must be tree recursive.
-  static void destroy_nodes_impl(Node *node) {
+  // NOTE:    Frees nodes in post-order, unlinking each from its parent so
+  //          that the walk can climb back up without revisiting it.
+  static void destroy_nodes_impl(Node *node, NodeAlloc &alloc) {
     if(!node)
       return;
 
-    destroy_nodes_impl(node->left);
-    destroy_nodes_impl(node->right);
+    Node *top = node->parent;
+    while(node != top) {
+      if(node->left) {
+        node = node->left;
+      }
+      else if(node->right) {
+        node = node->right;
+      }
+      else {
+        Node *parent = node->parent;
+        if(parent && parent->left == node)
+          parent->left = nullptr;
+        else if(parent)
+          parent->right = nullptr;
+        free_node_impl(node, alloc);
+        node = parent;
+      }
+    }
+  }
+
+  // REQUIRES: [first, first + count) is in strictly increasing order
+  // EFFECTS : Builds a tree holding the 'count' elements starting at
+  //           'first' and returns its root. Every subtree splits its
+  //           elements evenly between left and right, so the subtree
+  //           heights differ by at most one and the result satisfies any
+  //           balancing policy.
+  // NOTE:    The natural algorithm is "build the left half, take the next
+  //          element, build the right half". That is simulated here with
+  //          a frame array, which never needs more than about log2(count)
+  //          frames, so the elements are consumed in order in one pass.
+  template <typename ForwardIt>
+  static Node *build_sorted_impl(ForwardIt first, size_t count,
+                                 NodeAlloc &alloc) {
+    struct Frame {
+      size_t count;
+      Node *node;
+      int stage;
+    };
+    Frame frames[2 * sizeof(size_t) * 8 + 2];
+    int top = 0;
+    Node *built = nullptr;
+    frames[top++] = Frame{count, nullptr, 0};
+    while(top > 0) {
+      Frame &frame = frames[top - 1];
+      if(frame.count == 0) {
+        built = nullptr;
+        --top;
+      }
+      else if(frame.stage == 0) {
+        // Build the left half first
+        frame.stage = 1;
+        frames[top++] = Frame{frame.count / 2, nullptr, 0};
+      }
+      else if(frame.stage == 1) {
+        // Then the middle element, then the right half
+        frame.node = create_node_impl(alloc, *first);
+        ++first;
+        frame.node->left = built;
+        if(built)
+          built->parent = frame.node;
+        frame.stage = 2;
+        frames[top++] = Frame{frame.count - frame.count / 2 - 1, nullptr, 0};
+      }
+      else {
+        frame.node->right = built;
+        if(built)
+          built->parent = frame.node;
+        update_impl(frame.node);
+        built = frame.node;
+        --top;
+      }
+    }
+    return built;
+  }
+
+  // EFFECTS: Obtains a node from 'alloc' holding a copy of the element in
+  //          'node' and the same cached height and size, with no parent
+  //          or children, and returns a pointer to it.
+  static Node *clone_node_impl(const Node *node, NodeAlloc &alloc) {
+    Node *copy = create_node_impl(alloc, node->datum);
+    copy->height = node->height;
+    copy->size = node->size;
+    return copy;
+  }
+
+  // EFFECTS: Obtains a node from 'alloc' holding an element constructed
+  //          from 'args', with no parent or children, and returns a
+  //          pointer to it.
+  template <typename... Args>
+  static Node *create_node_impl(NodeAlloc &alloc, Args &&... args) {
+    Node *node = NodeTraits::allocate(alloc, 1);
+    try {
+      NodeTraits::construct(alloc, node, std::in_place,
+                            std::forward<Args>(args)...);
+    }
+    catch (...) {
+      NodeTraits::deallocate(alloc, node, 1);
+      throw;
+    }
+    return node;
+  }
 
-    delete node;
+  // EFFECTS: Destroys 'node' and returns its memory to 'alloc'.
+  static void free_node_impl(Node *node, NodeAlloc &alloc) {
+    NodeTraits::destroy(alloc, node);
+    NodeTraits::deallocate(alloc, node, 1);
   }
 
+  // A query being searched for, along with its prefix when nodes cache
+  // theirs. before() and after() compare it with the element in a node,
+  // calling 'less' only when the prefixes are equal.
+  template <typename K>
+  class Probe {
+  public:
+    Probe(const K &query_in, const Comparator &less_in)
+      : query(query_in), less(less_in), prefix(prefix_of(query_in)) { }
+
+    // EFFECTS: Returns whether the query is less than the element in
+    //          'node'.
+    bool before(const Node *node) const {
+      if constexpr (Prefix::enabled) {
+        if(prefix != node->prefix)
+          return prefix < node->prefix;
+      }
+      return less(query, node->datum);
+    }
+
+    // EFFECTS: Returns whether the element in 'node' is less than the
+    //          query.
+    bool after(const Node *node) const {
+      if constexpr (Prefix::enabled) {
+        if(prefix != node->prefix)
+          return node->prefix < prefix;
+      }
+      return less(node->datum, query);
+    }
+
+  private:
+    const K &query;
+    Comparator less;
+    std::uint64_t prefix;
+
+    static std::uint64_t prefix_of(const K &query) {
+      if constexpr (Prefix::enabled)
+        return Prefix::of(query);
+      else
+        return 0;
+    }
+  };
+
   // EFFECTS : Searches the tree rooted at 'node' for an element equivalent
   //           to 'query'. If one is found, returns a pointer to the node
   //           containing it. If the tree is empty or the element is not
   //           found, returns a null pointer.
   //
-  // NOTE: This function must be tail recursive.
   // HINT: Equivalence is defined according to the Compare functor
   //       associated with this instantiation of the BinarySearchTree
   //       template, NOT according to the == operator. Use the "less"
   //       parameter to compare elements.
   //       Two elements A and B are equivalent if and only if A is
   //       not less than B and B is not less than A.
-  static Node * find_impl(Node *node, const T &query, Compare less) {
-    if(!node)
-      return nullptr;
+  template <typename K>
+  static Node * find_impl(Node *node, const K &query, Comparator less) {
+    count_search(less);
+    Probe<K> probe(query, less);
+    while(node) {
+      count_visit(less);
+      if(probe.before(node))
+        node = node->left;
+      else if(probe.after(node))
+        node = node->right;
+      else
+        return node;
+    }
+    return nullptr;
+  }
 
-    if(less(query, node->datum))
-      return find_impl(node->left, query, less);
-    else if(less(node->datum, query))
-      return find_impl(node->right, query, less);
-    else
+  // MODIFIES: 'found'
+  // EFFECTS : Searches the tree rooted at 'node' like find_impl, but
+  //           returns the last node visited, which holds the element
+  //           equivalent to 'query' if there is one, and sets 'found' to
+  //           whether there is. Returns a null pointer for an empty tree.
+  template <typename K>
+  static Node * search_impl(Node *node, const K &query, Comparator less,
+                            bool &found) {
+    count_search(less);
+    Probe<K> probe(query, less);
+    Node *last = nullptr;
+    while(node) {
+      count_visit(less);
+      last = node;
+      if(probe.before(node))
+        node = node->left;
+      else if(probe.after(node))
+        node = node->right;
+      else {
+        found = true;
+        return node;
+      }
+    }
+    return last;
+  }
+
+  // REQUIRES: 'node' is null or a node of the tree rooted at 'root'
+  // EFFECTS : Returns a pointer to the node holding an element equivalent
+  //           to 'query', or a null pointer if there is none, searching
+  //           from 'node' (from 'root' if 'node' is null). Climbs while
+  //           'query' lies beyond the nearest ancestor bounding the
+  //           current subtree on that side, then searches down.
+  template <typename K>
+  static Node * find_from_impl(Node *node, Node *root, const K &query,
+                               Comparator less) {
+    if(!node)
+      return find_impl(root, query, less);
+    if(less(query, node->datum)) {
+      // Climb until an ancestor is below 'query' from the left
+      while(node->parent) {
+        count_visit(less);
+        Node *parent = node->parent;
+        if(parent->right == node && less(parent->datum, query))
+          break;
+        node = parent;
+      }
+    }
+    else if(less(node->datum, query)) {
+      while(node->parent) {
+        count_visit(less);
+        Node *parent = node->parent;
+        if(parent->left == node && less(query, parent->datum))
+          break;
+        node = parent;
+      }
+    }
+    else {
       return node;
+    }
+    return find_impl(node, query, less);
+  }
+
+  // REQUIRES: 'leaf' is a detached node whose element belongs between
+  //           'prev' and 'next', which are neighbours in the tree rooted
+  //           at 'root' (a null 'prev' or 'next' means the element is the
+  //           new minimum or maximum)
+  // MODIFIES: the tree rooted at 'root'
+  // EFFECTS : Links 'leaf' in without comparing any elements and returns
+  //           the root of the tree. One of the two neighbours is always
+  //           free on the side facing the other, since one of them is
+  //           an ancestor of the other.
+  static Node * insert_between_impl(Node *root, Node *prev, Node *next,
+                                    Node *leaf) {
+    if(!root)
+      return leaf;
+    if(next && !next->left) {
+      next->left = leaf;
+      leaf->parent = next;
+    }
+    else {
+      prev->right = leaf;
+      leaf->parent = prev;
+    }
+    return rebalance_path_impl(leaf->parent);
   }
 
-  // REQUIRES: item is not already contained in the tree rooted at 'node'
+  // REQUIRES: 'leaf' is a detached node whose element is not already
+  //           contained in the tree rooted at 'node'
   // MODIFIES: the tree rooted at 'node'
-  // EFFECTS : If 'node' represents an empty tree, allocates a new
-  //           Node to represent a single-element tree with 'item' as
-  //           its only element and returns a pointer to the new Node.
-  //           If the tree rooted at 'node' is not empty, inserts
-  //           'item' into the proper location as a leaf in the
-  //           existing tree structure according to the sorting
-  //           invariant and returns the original parameter 'node'.
-  // NOTE: This function must be linear recursive, but does not
-  //       need to be tail recursive.
+  // EFFECTS : If 'node' represents an empty tree, returns 'leaf' as the
+  //           root of a single-element tree.
+  //           If the tree rooted at 'node' is not empty, links 'leaf'
+  //           into the proper location in the existing tree structure
+  //           according to the sorting invariant and returns the root of
+  //           the tree, which may differ from 'node' if the balancing
+  //           policy rotated it.
   // HINT: Element ordering is defined according to the Compare functor
   //       associated with this instantiation of the BinarySearchTree
   //       template, NOT according to the < operator. Use the "less"
   //       parameter to compare elements.
-  static Node * insert_impl(Node *node, const T &item, Compare less) {
+  static Node * insert_impl(Node *node, Node *leaf, Comparator less) {
     if(!node)
-      node = new Node{item, nullptr, nullptr};
+      return leaf;
+
+    Node *parent = nullptr;
+    bool go_left = false;
+    count_search(less);
+    Probe<T> probe(leaf->datum, less);
+    while(node) {
+      count_visit(less);
+      parent = node;
+      go_left = probe.before(node);
+      node = go_left ? node->left : node->right;
+    }
+
+    leaf->parent = parent;
+    if(go_left)
+      parent->left = leaf;
+    else
+      parent->right = leaf;
+    return rebalance_path_impl(parent);
+  }
+
+  // REQUIRES: 'node' is in the tree rooted at 'root'
+  // MODIFIES: the tree rooted at 'root'
+  // EFFECTS : Unlinks 'node' from the tree without freeing it, and returns
+  //           the root of the remaining tree. A node with two children is
+  //           replaced by its in-order successor, so no element moves
+  //           between nodes and iterators to the others stay valid.
+  static Node * erase_impl(Node *root, Node *node) {
+    Node *replacement;
+    Node *rebalance_from;
+    if(node->left && node->right) {
+      replacement = min_element_impl(node->right);
+      if(replacement->parent == node) {
+        rebalance_from = replacement;
+      }
+      else {
+        // Lift the successor out of its spot; it has no left child
+        rebalance_from = replacement->parent;
+        replace_child_impl(rebalance_from, replacement, replacement->right);
+        replacement->right = node->right;
+        replacement->right->parent = replacement;
+      }
+      replacement->left = node->left;
+      replacement->left->parent = replacement;
+    }
+    else {
+      replacement = node->left ? node->left : node->right;
+      rebalance_from = node->parent;
+    }
+
+    replace_child_impl(node->parent, node, replacement);
+    if(!rebalance_from)
+      return replacement;
+    return rebalance_path_impl(rebalance_from);
+  }
+
+  // MODIFIES: 'parent', 'new_child'
+  // EFFECTS : Puts 'new_child' in the place of 'old_child' under 'parent'
+  //           and points it back at 'parent'. Either 'parent' or
+  //           'new_child' may be null.
+  static void replace_child_impl(Node *parent, Node *old_child,
+                                 Node *new_child) {
+    if(parent && parent->left == old_child)
+      parent->left = new_child;
+    else if(parent)
+      parent->right = new_child;
+    if(new_child)
+      new_child->parent = parent;
+  }
+
+  // MODIFIES: the tree containing 'node'
+  // EFFECTS : Rebalances 'node' and each of its ancestors in turn, from
+  //           the bottom up, and returns the root of the whole tree.
+  static Node * rebalance_path_impl(Node *node) {
+    while(true) {
+      Node *parent = node->parent;
+      bool is_left = parent && parent->left == node;
+      node = rebalance_impl(node);
+      if(!parent)
+        return node;
+      if(is_left)
+        parent->left = node;
+      else
+        parent->right = node;
+      node = parent;
+    }
+  }
+
+  // MODIFIES: 'node'
+  // EFFECTS : Recomputes the cached height and size of 'node' from its
+  //           children.
+  static void update_impl(Node *node) {
+    node->height = static_cast<Height_type>(
+      1 + std::max(height_impl(node->left), height_impl(node->right)));
+    node->size = static_cast<Size_type>(
+      1 + size_impl(node->left) + size_impl(node->right));
+  }
+
+  // REQUIRES: 'node' has a right child
+  // MODIFIES: the tree rooted at 'node'
+  // EFFECTS : Rotates the right child of 'node' up into its place and
+  //           returns it as the new root of the subtree.
+  static Node * rotate_left_impl(Node *node) {
+    count_rotation();
+    Node *pivot = node->right;
+    node->right = pivot->left;
+    if(node->right)
+      node->right->parent = node;
+    pivot->parent = node->parent;
+    pivot->left = node;
+    node->parent = pivot;
+    update_impl(node);
+    update_impl(pivot);
+    return pivot;
+  }
+
+  // REQUIRES: 'node' has a left child
+  // MODIFIES: the tree rooted at 'node'
+  // EFFECTS : Rotates the left child of 'node' up into its place and
+  //           returns it as the new root of the subtree.
+  static Node * rotate_right_impl(Node *node) {
+    count_rotation();
+    Node *pivot = node->left;
+    node->left = pivot->right;
+    if(node->left)
+      node->left->parent = node;
+    pivot->parent = node->parent;
+    pivot->right = node;
+    node->parent = pivot;
+    update_impl(node);
+    update_impl(pivot);
+    return pivot;
+  }
 
-    if(less(item, node->datum))
-      node->left = insert_impl(node->left, item, less);
-    else if(less(node->datum, item))
-      node->right = insert_impl(node->right, item, less);
+  // REQUIRES: 'node' has a parent
+  // MODIFIES: the tree containing 'node'
+  // EFFECTS : Rotates 'node' up into the place of its parent.
+  static void rotate_up_impl(Node *node) {
+    Node *parent = node->parent;
+    Node *grandparent = parent->parent;
+    bool parent_is_left = grandparent && grandparent->left == parent;
+    Node *top = parent->left == node ? rotate_right_impl(parent)
+                                     : rotate_left_impl(parent);
+    if(grandparent) {
+      if(parent_is_left)
+        grandparent->left = top;
+      else
+        grandparent->right = top;
+    }
+  }
+
+  // MODIFIES: the tree containing 'node'
+  // EFFECTS : Moves 'node' to the root of its tree with splay steps and
+  //           returns it. When 'node' and its parent are children on the
+  //           same side, the parent is rotated up before 'node', which
+  //           roughly halves the depth of every node on the path.
+  static Node * splay_impl(Node *node) {
+    while(node->parent) {
+      Node *parent = node->parent;
+      Node *grandparent = parent->parent;
+      if(grandparent
+         && (grandparent->left == parent) == (parent->left == node))
+        rotate_up_impl(parent);
+      rotate_up_impl(node);
+      if(grandparent && node->parent == grandparent)
+        rotate_up_impl(node);
+    }
+    return node;
+  }
+
+  // REQUIRES: the subtrees of 'node' satisfy the balancing policy and
+  //           their heights differ by at most two
+  // MODIFIES: the tree rooted at 'node'
+  // EFFECTS : Refreshes the cached height of 'node' and, if the balancing
+  //           policy calls for it, rotates the subtree back into shape.
+  //           Returns the root of the resulting subtree.
+  static Node * rebalance_impl(Node *node) {
+    update_impl(node);
+    if constexpr (std::is_same_v<Balance, AvlBalance>) {
+      int balance = height_impl(node->left) - height_impl(node->right);
+      if(balance > 1) {
+        if(height_impl(node->left->left) < height_impl(node->left->right))
+          node->left = rotate_left_impl(node->left);
+        return rotate_right_impl(node);
+      }
+      if(balance < -1) {
+        if(height_impl(node->right->right) < height_impl(node->right->left))
+          node->right = rotate_right_impl(node->right);
+        return rotate_left_impl(node);
+      }
+    }
+    return node;
+  }
+
+  // MODIFIES: 'child'
+  // EFFECTS : Cuts the subtree 'child' off its parent and returns it as a
+  //           tree of its own.
+  static Node * detach_impl(Link &child) {
+    Node *node = child;
+    child = nullptr;
+    if(node)
+      node->parent = nullptr;
+    return node;
+  }
+
+  // REQUIRES: 'left' and 'right' are separate AVL trees, and every element
+  //           of 'left' is less than the datum in 'middle', which is less
+  //           than every element of 'right'
+  // MODIFIES: 'left', 'middle', 'right'
+  // EFFECTS : Joins the three into one AVL tree and returns its root, in
+  //           O(difference in height of 'left' and 'right').
+  // NOTE:    The shorter tree hangs under 'middle', which is linked in
+  //          along the spine of the taller tree where heights match, and
+  //          the path above it is rebalanced as after an insertion.
+  static Node * join_impl(Node *left, Node *middle, Node *right) {
+    middle->parent = nullptr;
+    int left_height = height_impl(left);
+    int right_height = height_impl(right);
+    if(left_height > right_height + 1) {
+      Node *spine = left;
+      while(height_impl(spine->right) > right_height + 1)
+        spine = spine->right;
+      middle->left = detach_impl(spine->right);
+      middle->right = right;
+      link_children_impl(middle);
+      spine->right = middle;
+      middle->parent = spine;
+      return rebalance_path_impl(spine);
+    }
+    if(right_height > left_height + 1) {
+      Node *spine = right;
+      while(height_impl(spine->left) > left_height + 1)
+        spine = spine->left;
+      middle->left = left;
+      middle->right = detach_impl(spine->left);
+      link_children_impl(middle);
+      spine->left = middle;
+      middle->parent = spine;
+      return rebalance_path_impl(spine);
+    }
+    middle->left = left;
+    middle->right = right;
+    link_children_impl(middle);
+    return middle;
+  }
+
+  // REQUIRES: every element of 'left' is less than every element of
+  //           'right'
+  // MODIFIES: 'left', 'right'
+  // EFFECTS : Joins two AVL trees into one, using the maximum of 'left'
+  //           as the middle, and returns its root.
+  static Node * join_two_impl(Node *left, Node *right) {
+    if(!left)
+      return right;
+    Node *middle = max_element_impl(left);
+    left = erase_impl(left, middle);
+    return join_impl(left, middle, right);
+  }
+
+  // MODIFIES: 'node'
+  // EFFECTS : Points the children of 'node' back at it and refreshes its
+  //           cached height and size.
+  static void link_children_impl(Node *node) {
+    if(node->left)
+      node->left->parent = node;
+    if(node->right)
+      node->right->parent = node;
+    update_impl(node);
+  }
+
+  // MODIFIES: the tree rooted at 'node', 'left', 'right'
+  // EFFECTS : Splits the AVL tree rooted at 'node' into 'left', holding the
+  //           elements less than 'key', and 'right', holding those
+  //           greater. Returns the detached node holding an element
+  //           equivalent to 'key', or a null pointer if there is none.
+  //           Runs in O(height).
+  // NOTE:    Walks down to where 'key' belongs, then climbs back up
+  //          through the parent pointers, joining each ancestor and its
+  //          other subtree onto the side it belongs to.
+  template <typename K>
+  static Node * split_impl(Node *node, const K &key, Comparator less,
+                           Node *&left, Node *&right) {
+    left = right = nullptr;
+    Node *parent = nullptr;
+    while(node) {
+      if(less(key, node->datum)) {
+        parent = node;
+        node = node->left;
+      }
+      else if(less(node->datum, key)) {
+        parent = node;
+        node = node->right;
+      }
+      else {
+        left = detach_impl(node->left);
+        right = detach_impl(node->right);
+        parent = node->parent;
+        node->parent = nullptr;
+        update_impl(node);
+        break;
+      }
+    }
 
+    while(parent) {
+      Node *next = parent->parent;
+      if(less(key, parent->datum))
+        right = join_impl(right, parent, detach_impl(parent->right));
+      else
+        left = join_impl(detach_impl(parent->left), parent, left);
+      parent = next;
+    }
     return node;
   }
 
+  // REQUIRES: 'a' and 'b' are separate AVL trees
+  // MODIFIES: the trees rooted at 'a' and 'b'
+  // EFFECTS : Combines the two trees according to 'Op', freeing the nodes
+  //           that are not kept, and returns the root of the result.
+  //           While 'forks' is positive, the left halves of large
+  //           subproblems are solved on another thread.
+  // NOTE:    This recurses, but only as deep as the AVL tree 'a' is
+  //          tall.
+  template <SetOp Op, typename Combiner>
+  static Node * set_op_impl(Node *a, Node *b, Combiner &combine,
+                            Comparator less, NodeAlloc &alloc, int forks) {
+    if(!a || !b) {
+      if(Op == SetOp::Union)
+        return a ? a : b;
+      destroy_nodes_impl(b, alloc);
+      if(Op == SetOp::Difference)
+        return a;
+      destroy_nodes_impl(a, alloc);
+      return nullptr;
+    }
+
+    bool fork = forks > 0 && a->size + b->size >= parallel_grain;
+    int child_forks = fork ? forks - 1 : forks;
+    Node *b_left;
+    Node *b_right;
+    Node *match = split_impl(b, a->datum, less, b_left, b_right);
+    Node *a_left = detach_impl(a->left);
+    Node *a_right = detach_impl(a->right);
+
+    bool keep = Op == SetOp::Difference ? !match : Op == SetOp::Union || match;
+    if(match) {
+      if(keep)
+        combine(a->datum, std::move(match->datum));
+      free_node_impl(match, alloc);
+    }
+
+    auto solve_left = [&]() {
+      return set_op_impl<Op>(a_left, b_left, combine, less, alloc,
+                             child_forks);
+    };
+    Node *left;
+    Node *right;
+    if(fork) {
+      std::future<Node *> pending = std::async(std::launch::async,
+                                               solve_left);
+      right = set_op_impl<Op>(a_right, b_right, combine, less, alloc,
+                              child_forks);
+      left = pending.get();
+    }
+    else {
+      left = solve_left();
+      right = set_op_impl<Op>(a_right, b_right, combine, less, alloc,
+                              child_forks);
+    }
+
+    if(keep)
+      return join_impl(left, a, right);
+    free_node_impl(a, alloc);
+    return join_two_impl(left, right);
+  }
+
+  // EFFECTS : Returns how many times the set operations may fork: enough
+  //           to keep every hardware thread busy, or none if nodes come
+  //           from an allocator that may not be safe to share between
+  //           threads.
+  static int fork_depth_impl() {
+    int depth = 0;
+#ifndef BST_INSTRUMENTATION
+    // (The counts in TreeStats are not atomic, so instrumented trees
+    // stay on one thread)
+    if constexpr (std::is_same_v<NodeAlloc, std::allocator<Node>>) {
+      for(unsigned n = std::thread::hardware_concurrency(); n > 1; n /= 2)
+        ++depth;
+    }
+#endif
+    return depth;
+  }
+
   // EFFECTS : Returns a pointer to the Node containing the minimum element
   //           in the tree rooted at 'node' or a null pointer if the tree is empty.
-  // NOTE: This function must be tail recursive.
   // NOTE: This function is used in the implementation of the ++ operator for
   //       the iterator code that is provided for you.
-  // HINT: You don't need to compare any elements! Think about the
-  //       structure, and where the smallest element lives.
   static Node * min_element_impl(Node *node) {
     if(!node)
       return nullptr;
-    if(!node->left)
-      return node;
-    return min_element_impl(node->left);
+    while(node->left)
+      node = node->left;
+    return node;
   }
 
   // EFFECTS : Returns a pointer to the Node containing the maximum element
   //           in the tree rooted at 'node' or a null pointer if the tree is empty.
-  // NOTE: This function must be tail recursive.
-  // HINT: You don't need to compare any elements! Think about the
-  //       structure, and where the largest element lives.
   static Node * max_element_impl(Node *node) {
     if(!node)
       return nullptr;
-    if(!node->right)
-      return node;
-    return max_element_impl(node->right);
+    while(node->right)
+      node = node->right;
+    return node;
   }
 
-  static const Node* find_max(const Node* node, Compare less) {
-    if(!node)
-      return nullptr;
-    if(!node->left && !node->right)
-      return node;
-
-    const Node* left = find_max(node->left, less);
-    const Node* right = find_max(node->right, less);
-
-    const Node* res;
-    if(!left)
-      res = right;
-    else if(!right)
-      res = left;
-    else
-      res = (less(left->datum, right->datum)) ? right : left;
-    return (less(node->datum, res->datum)) ? res : node;
+  // EFFECTS : Returns the number of elements in the tree rooted at 'node'
+  //           that are less than 'query'.
+  template <typename K>
+  static size_t rank_impl(const Node *node, const K &query, Comparator less) {
+    size_t smaller = 0;
+    count_search(less);
+    while(node) {
+      count_visit(less);
+      if(less(node->datum, query)) {
+        smaller += size_impl(node->left) + 1;
+        node = node->right;
+      }
+      else {
+        node = node->left;
+      }
+    }
+    return smaller;
   }
 
-  static const Node* find_min(const Node* node, Compare less) {
-    if(!node)
-      return nullptr;
-    if(!node->left && !node->right)
-      return node;
+  // EFFECTS : Returns a pointer to the node holding the element at
+  //           position 'k' in the sorted order of the tree rooted at
+  //           'node', or a null pointer if the tree has no more than 'k'
+  //           elements.
+  static Node * select_impl(Node *node, size_t k) {
+    while(node) {
+      size_t left_size = size_impl(node->left);
+      if(k == left_size)
+        return node;
+      if(k < left_size) {
+        node = node->left;
+      }
+      else {
+        k -= left_size + 1;
+        node = node->right;
+      }
+    }
+    return nullptr;
+  }
 
-    const Node* left = find_min(node->left, less);
-    const Node* right = find_min(node->right, less);
+  // REQUIRES: 'node' is not null
+  // EFFECTS : Returns the in-order successor of 'node', or a null pointer
+  //           if 'node' holds the largest element. If 'node' has no right
+  //           child, the successor is the closest ancestor whose left
+  //           subtree contains 'node'.
+  // NOTE: Every ancestor climbed past is visited at most once during a
+  //       full in-order walk, so iterating over the whole tree is O(n).
+  static Node * successor_impl(Node *node) {
+    if(node->right)
+      return min_element_impl(node->right);
+    Node *parent = node->parent;
+    while(parent && parent->right == node) {
+      node = parent;
+      parent = node->parent;
+    }
+    return parent;
+  }
 
-    const Node* res;
-    if(!left)
-      res = right;
-    else if(!right)
-      res = left;
-    else
-      res = (!less(right->datum, left->datum)) ? left : right;
-    return (!less(res->datum, node->datum)) ? node : res;
+  // REQUIRES: 'node' is not null
+  // EFFECTS : Returns the in-order predecessor of 'node', or a null
+  //           pointer if 'node' holds the minimum element.
+  static Node * predecessor_impl(Node *node) {
+    if(node->left)
+      return max_element_impl(node->left);
+    Node *parent = node->parent;
+    while(parent && parent->left == node) {
+      node = parent;
+      parent = node->parent;
+    }
+    return parent;
   }
 
   // EFFECTS: Returns whether the sorting invariant holds on the tree
   //          rooted at 'node'.
-  // NOTE:    This function must be tree recursive.
-  static bool check_sorting_invariant_impl(const Node *node, Compare less) {
-    if(!node)
+  // NOTE:    The invariant holds exactly when an in-order walk visits the
+  //          elements in strictly increasing order, so this compares each
+  //          element with the one before it, in O(n) total.
+  static bool check_sorting_invariant_impl(Node *node, Comparator less) {
+    Node *prev = min_element_impl(node);
+    if(!prev)
       return true;
 
-    const Node* max = find_max(node->left, less);
-    const Node* min = find_min(node->right, less);
-    if((max && !less(max->datum, node->datum)) || (min && less(min->datum, node->datum)))
-      return false;
+    for(Node *next = successor_impl(prev); next;
+        prev = next, next = successor_impl(next)) {
+      if(!less(prev->datum, next->datum))
+        return false;
+    }
+    return true;
+  }
 
-    return check_sorting_invariant_impl(node->left, less) && check_sorting_invariant_impl(node->right, less);
+  // EFFECTS: Returns whether every node on the path from 'node' to the
+  //          element at position 'k' lies strictly between the nearest
+  //          ancestors it is to the right and to the left of, has a
+  //          parent pointer back to the node above, and has the cached
+  //          size its children add up to.
+  static bool check_path_impl(const Node *node, size_t k, Comparator less) {
+    const Node *lower = nullptr;
+    const Node *upper = nullptr;
+    while(node) {
+      if((lower && !less(lower->datum, node->datum))
+         || (upper && !less(node->datum, upper->datum))
+         || node->size != 1 + size_impl(node->left) + size_impl(node->right))
+        return false;
+
+      const Node *next;
+      size_t left_size = size_impl(node->left);
+      if(k == left_size)
+        return true;
+      if(k < left_size) {
+        upper = node;
+        next = node->left;
+      }
+      else {
+        k -= left_size + 1;
+        lower = node;
+        next = node->right;
+      }
+      if(next && next->parent != node)
+        return false;
+      node = next;
+    }
+    return false;
+  }
+
+  // REQUIRES: 'node' is the root of its tree and 'counts' has room for
+  //           its height, all zero
+  // MODIFIES: counts
+  // EFFECTS : Adds one to counts[d] for each node at depth d, walking the
+  //           tree in order and tracking the depth as the walk moves
+  //           between parent and child.
+  static void depth_histogram_impl(const Node *node, size_t *counts) {
+    if(!node)
+      return;
+    size_t depth = 0;
+    for(; node->left; node = node->left)
+      ++depth;
+
+    while(node) {
+      ++counts[depth];
+      if(node->right) {
+        node = node->right;
+        ++depth;
+        for(; node->left; node = node->left)
+          ++depth;
+      }
+      else {
+        // Climb past the ancestors whose right subtree this was, then
+        // to the one whose left subtree it was
+        const Node *parent = node->parent;
+        while(parent && parent->right == node) {
+          node = parent;
+          parent = node->parent;
+          --depth;
+        }
+        node = parent;
+        if(node)
+          --depth;
+      }
+    }
   }
 
   // EFFECTS : Traverses the tree rooted at 'node' using an in-order traversal,
   //           printing each element to os in turn. Each element is followed
   //           by a space (there will be an "extra" space at the end).
   //           If the tree is empty, nothing is printed.
-  // NOTE: This function must be tree recursive.
-  //       See https://en.wikipedia.org/wiki/Tree_traversal#In-order
+  // NOTE: See https://en.wikipedia.org/wiki/Tree_traversal#In-order
   //       for the definition of a in-order traversal.
-  static void traverse_inorder_impl(const Node *node, std::ostream &os) {
-    if(!node)
-      return;
-
-    traverse_inorder_impl(node->left, os);
-    os << node->datum << " ";
-    traverse_inorder_impl(node->right, os);
+  static void traverse_inorder_impl(Node *node, std::ostream &os) {
+    for(node = min_element_impl(node); node; node = successor_impl(node))
+      os << node->datum << " ";
   }
 
   // EFFECTS : Traverses the tree rooted at 'node' using a pre-order traversal,
   //           printing each element to os in turn. Each element is followed
   //           by a space (there will be an "extra" space at the end).
   //           If the tree is empty, nothing is printed.
-  // NOTE: This function must be tree recursive.
-  //       See https://en.wikipedia.org/wiki/Tree_traversal#Pre-order
+  // NOTE: See https://en.wikipedia.org/wiki/Tree_traversal#Pre-order
   //       for the definition of a pre-order traversal.
   static void traverse_preorder_impl(const Node *node, std::ostream &os) {
-    if(!node)
-      return;
-
-    os << node->datum << " ";
-    traverse_preorder_impl(node->left, os);
-    traverse_preorder_impl(node->right, os); 
+    const Node *top = node;
+    while(node) {
+      os << node->datum << " ";
+      if(node->left) {
+        node = node->left;
+      }
+      else if(node->right) {
+        node = node->right;
+      }
+      else {
+        // Climb until we come up out of a left subtree whose parent has
+        // a right subtree still to visit
+        while(node != top && (node->parent->right == node ||
+                              !node->parent->right))
+          node = node->parent;
+        node = (node == top) ? nullptr : node->parent->right;
+      }
+    }
   }
 
   // EFFECTS : Returns a pointer to the Node containing the smallest element
@@ -548,26 +2391,46 @@ private:
   //           Returns a null pointer if the tree is empty or if it does not
   //           contain any elements that are greater than 'val'.
   //
-  // NOTE: This function must be linear recursive.
-  // NOTE: This function is used in the implementation of the ++ operator for
-  //       the iterator code that is provided for you.
   // HINT: At each step, compare 'val' the the current node (using the
   //       'less' parameter). Based on the result, you gain some information
   //       about where the element you're looking for could be.
-  static Node * min_greater_than_impl(Node *node, const T &val, Compare less) {
-    if(!node)
-      return nullptr;
-
+  template <typename K>
+  static Node * min_greater_than_impl(Node *node, const K &val, Comparator less) {
     Node* res = nullptr;
+    count_search(less);
+    while(node) {
+      count_visit(less);
+      if(less(val, node->datum)) {
+        // This node is a candidate, but a smaller one may be to its left
+        res = node;
+        node = node->left;
+      }
+      else {
+        node = node->right;
+      }
+    }
+    return res;
+  }
 
-    if(less(val, node->datum))
-      res = min_greater_than_impl(node->left, val, less);
-    else
-      res = min_greater_than_impl(node->right, val, less);
-      
-    if(less(val, node->datum) && res == nullptr)
-      res = node;
-
+  // EFFECTS : Returns a pointer to the Node containing the smallest element
+  //           in the tree rooted at 'node' that is not less than 'query',
+  //           or a null pointer if there is none.
+  template <typename K>
+  static Node * lower_bound_impl(Node *node, const K &query, Comparator less) {
+    Node *res = nullptr;
+    count_search(less);
+    Probe<K> probe(query, less);
+    while(node) {
+      count_visit(less);
+      if(probe.after(node)) {
+        node = node->right;
+      }
+      else {
+        // This node is a candidate, but a smaller one may be to its left
+        res = node;
+        node = node->left;
+      }
+    }
     return res;
   }
 
@@ -589,9 +2452,10 @@ private:
 //           BinarySearchTree Iterator, which in turn depends on some
 //           of the functions you must write.
 
-template <typename T, typename Compare>
+template <typename T, typename Compare, typename Balance, typename Allocator>
 std::ostream &operator<<(std::ostream &os,
-                         const BinarySearchTree<T, Compare> &tree) {
+                         const BinarySearchTree<T, Compare, Balance,
+                                                Allocator> &tree) {
 // DO NOT CHANGE THE IMPLEMENTATION OF THIS FUNCTION
   os << "[ ";
   for (T& elt : tree) {
@@ -1,5 +1,20 @@
 #include "BinarySearchTree.hpp"
+#include "Arena.hpp"
+#include "NodePool.hpp"
+#include "Serialize.hpp"
 #include "unit_test_framework.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iterator>
+#include <memory_resource>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 TEST(basic_ctor) {
     BinarySearchTree<int> tree;
@@ -361,4 +376,1206 @@ TEST(enumerate) {
     ASSERT_EQUAL(result.str(), "6 12 13 15 19 20 ");
 }
 
+TEST(avl_rotations) {
+    BinarySearchTree<int, std::less<int>, AvlBalance> right_right;
+    right_right.insert(1);
+    right_right.insert(2);
+    right_right.insert(3);
+
+    std::stringstream preorder;
+    right_right.traverse_preorder(preorder);
+    ASSERT_EQUAL(preorder.str(), "2 1 3 ");
+    ASSERT_EQUAL(right_right.height(), 2);
+
+    BinarySearchTree<int, std::less<int>, AvlBalance> left_right;
+    left_right.insert(3);
+    left_right.insert(1);
+    left_right.insert(2);
+
+    std::stringstream preorder_2;
+    left_right.traverse_preorder(preorder_2);
+    ASSERT_EQUAL(preorder_2.str(), "2 1 3 ");
+    ASSERT_TRUE(left_right.check_sorting_invariant());
+}
+
+TEST(avl_sorted_insert_height) {
+    BinarySearchTree<int, std::less<int>, AvlBalance> tree;
+    const int count = 1000000;
+    for(int i = 0; i < count; ++i)
+        tree.insert(i);
+
+    ASSERT_EQUAL(tree.size(), count);
+    ASSERT_TRUE(tree.height() <= 1.44 * std::log2(count + 2));
+    ASSERT_EQUAL(*tree.min_element(), 0);
+    ASSERT_EQUAL(*tree.max_element(), count - 1);
+    ASSERT_EQUAL(*tree.find(count / 2), count / 2);
+}
+
+TEST(avl_descending_insert) {
+    BinarySearchTree<int, std::less<int>, AvlBalance> tree;
+    for(int i = 1000; i > 0; --i)
+        tree.insert(i);
+
+    ASSERT_TRUE(tree.height() <= 1.44 * std::log2(1000 + 2));
+    ASSERT_TRUE(tree.check_sorting_invariant());
+
+    int expected = 1;
+    for(int e : tree)
+        ASSERT_EQUAL(e, expected++);
+}
+
+TEST(iterate_after_rotations) {
+    BinarySearchTree<int, std::less<int>, AvlBalance> tree;
+    for(int i = 0; i < 500; ++i)
+        tree.insert((i * 7919) % 500);
+
+    int expected = 0;
+    for(auto it = tree.begin(); it != tree.end(); it++)
+        ASSERT_EQUAL(*it, expected++);
+    ASSERT_EQUAL(expected, 500);
+}
+
+TEST(iterate_copy) {
+    BinarySearchTree<int> tree;
+    tree.insert(8);
+    tree.insert(4);
+    tree.insert(12);
+    tree.insert(2);
+    tree.insert(6);
+    tree.insert(5);
+
+    BinarySearchTree<int> tree_2(tree);
+    std::stringstream result;
+    for(int e : tree_2)
+        result << e << " ";
+    ASSERT_EQUAL(result.str(), "2 4 5 6 8 12 ");
+}
+
+TEST(arena_allocator) {
+    Arena arena;
+    BinarySearchTree<int, std::less<int>, AvlBalance, ArenaAllocator<int>>
+        tree(arena);
+    for(int i = 0; i < 1000; ++i)
+        tree.insert(i);
+
+    ASSERT_EQUAL(arena.allocation_count(), 1000);
+    ASSERT_TRUE(arena.slab_count() < 10);
+    ASSERT_TRUE(tree.check_sorting_invariant());
+
+    auto tree_2 = tree;
+    ASSERT_TRUE(tree_2.get_allocator() == tree.get_allocator());
+    ASSERT_EQUAL(arena.allocation_count(), 2000);
+    tree_2.insert(1000);
+    ASSERT_EQUAL(arena.allocation_count(), 2001);
+    ASSERT_EQUAL(*tree_2.find(500), 500);
+}
+
+// Allocates like std::allocator, but claims room for only three objects
+template <typename T>
+struct ThreeAllocator : std::allocator<T> {
+    template <typename U>
+    struct rebind {
+        using other = ThreeAllocator<U>;
+    };
+
+    ThreeAllocator() = default;
+
+    template <typename U>
+    ThreeAllocator(const ThreeAllocator<U> &) { }
+
+    size_t max_size() const {
+        return 3;
+    }
+};
+
+TEST(max_size) {
+    // Only trees with packed counts stop at 2^32 - 1
+    BinarySearchTree<int> big;
+    ASSERT_TRUE(big.max_size() > size_t(UINT32_MAX));
+
+    BinarySearchTree<int, std::less<int>, NoBalance, ThreeAllocator<int>> tree;
+    ASSERT_EQUAL(tree.max_size(), 3);
+    tree.insert(1);
+    tree.insert(2);
+    tree.insert(tree.end(), 3);
+    bool threw = false;
+    try {
+        tree.insert(4);
+    }
+    catch(const std::length_error &) {
+        threw = true;
+    }
+    ASSERT_TRUE(threw);
+    ASSERT_EQUAL(tree.size(), 3);
+    ASSERT_FALSE(tree.contains(4));
+}
+
+// Counts up through the ints, for a sorted range too big to store
+struct CountingIterator {
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = int;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const int *;
+    using reference = int;
+
+    size_t i;
+
+    int operator*() const { return static_cast<int>(i); }
+    CountingIterator &operator++() { ++i; return *this; }
+    difference_type operator-(const CountingIterator &rhs) const {
+        return static_cast<difference_type>(i - rhs.i);
+    }
+    bool operator==(const CountingIterator &rhs) const { return i == rhs.i; }
+    bool operator!=(const CountingIterator &rhs) const { return i != rhs.i; }
+};
+
+TEST(node_pool) {
+    NodePool pool(100);
+    BinarySearchTree<int, std::less<int>, AvlBalance, NodePoolAllocator<int>>
+        tree(pool);
+    ASSERT_EQUAL(tree.max_size(), 100);
+    for (int i = 0; i < 98; ++i) {
+        tree.insert(i);
+    }
+    tree.emplace(98);
+    tree.insert(tree.end(), 99);
+    ASSERT_EQUAL(pool.in_use(), 100);
+
+    // Every way in stops at the pool's capacity, leaving the tree alone
+    bool threw = false;
+    try {
+        tree.insert(100);
+    }
+    catch (const std::length_error &) {
+        threw = true;
+    }
+    ASSERT_TRUE(threw);
+    threw = false;
+    try {
+        tree.emplace_hint(tree.end(), 100);
+    }
+    catch (const std::length_error &) {
+        threw = true;
+    }
+    ASSERT_TRUE(threw);
+    ASSERT_EQUAL(tree.size(), 100);
+    ASSERT_EQUAL(pool.in_use(), 100);
+    ASSERT_TRUE(tree.check_sorting_invariant());
+
+    // Freed slots are handed out again
+    tree.erase(50);
+    tree.insert(100);
+    ASSERT_EQUAL(pool.in_use(), 100);
+    ASSERT_EQUAL(*tree.find(100), 100);
+    tree.clear();
+    ASSERT_EQUAL(pool.in_use(), 0);
+
+    // A full-sized pool allows as many elements as it has 32-bit indices
+    // for their nodes, and no more
+    NodePool big_pool;
+    BinarySearchTree<int, std::less<int>, NoBalance, NodePoolAllocator<int>>
+        big(big_pool);
+    ASSERT_TRUE(big.max_size() < size_t(UINT32_MAX));
+    ASSERT_TRUE(big.max_size() > size_t(UINT32_MAX) / 2);
+    big.insert(-1);
+    threw = false;
+    try {
+        big.assign(sorted_unique, CountingIterator{0},
+                   CountingIterator{big.max_size() + 1});
+    }
+    catch (const std::length_error &) {
+        threw = true;
+    }
+    ASSERT_TRUE(threw);
+    ASSERT_EQUAL(big.size(), 1);
+    ASSERT_EQUAL(big_pool.in_use(), 1);
+}
+
+TEST(node_pool_links) {
+    // Nodes from a pool link to each other by 32-bit index, so an int
+    // node needs only 24 bytes
+    NodePool pool;
+    using Tree = BinarySearchTree<int, std::less<int>, AvlBalance,
+                                  NodePoolAllocator<int>>;
+    Tree tree(pool);
+    tree.insert(0);
+    ASSERT_TRUE(pool.slot_bytes() <= 24);
+
+    // Enough nodes to span several chunks, with rotations and erasures
+    std::minstd_rand random(280);
+    std::set<int> expected = {0};
+    for (int i = 0; i < 20000; ++i) {
+        int value = static_cast<int>(random() % 10000);
+        if (random() % 4 == 0) {
+            tree.erase(value);
+            expected.erase(value);
+        }
+        else if (!tree.contains(value)) {
+            tree.insert(value);
+            expected.insert(value);
+        }
+    }
+    ASSERT_TRUE(tree.check_sorting_invariant());
+    ASSERT_TRUE(std::equal(tree.begin(), tree.end(),
+                           expected.begin(), expected.end()));
+    ASSERT_TRUE(std::equal(tree.rbegin(), tree.rend(),
+                           expected.rbegin(), expected.rend()));
+    ASSERT_EQUAL(pool.in_use(), expected.size());
+
+    // Copies and set operations keep their links within the pool
+    Tree copy(tree);
+    Tree evens(pool);
+    for (int i = 0; i < 20000; i += 2) {
+        evens.insert(i);
+    }
+    copy.merge(std::move(evens));
+    ASSERT_EQUAL(copy.size(), expected.size() + 10000
+                 - std::count_if(expected.begin(), expected.end(),
+                                 [](int x) { return x % 2 == 0; }));
+    ASSERT_TRUE(copy.check_sorting_invariant());
+    ASSERT_EQUAL(pool.in_use(), expected.size() + copy.size());
+    std::ostringstream os;
+    copy.print_tree(os, 3);
+    ASSERT_FALSE(os.str().empty());
+
+    // Splaying relinks nodes at every lookup
+    NodePool splay_pool;
+    BinarySearchTree<int, std::less<int>, SplayBalance,
+                     NodePoolAllocator<int>> splay(splay_pool);
+    for (int i = 0; i < 5000; ++i) {
+        splay.insert((i * 7919) % 5000);
+    }
+    for (int i = 0; i < 5000; i += 3) {
+        ASSERT_EQUAL(*splay.find(i), i);
+    }
+    ASSERT_TRUE(splay.check_sorting_invariant());
+    ASSERT_EQUAL(splay.size(), 5000);
+}
+
+TEST(pmr_allocator) {
+    std::pmr::monotonic_buffer_resource resource;
+    BinarySearchTree<int, std::less<int>, NoBalance,
+                     std::pmr::polymorphic_allocator<int>> tree(&resource);
+    tree.insert(5);
+    tree.insert(3);
+    tree.insert(8);
+
+    ASSERT_EQUAL(tree.get_allocator().resource(), &resource);
+    ASSERT_EQUAL(tree.size(), 3);
+
+    std::stringstream result;
+    tree.traverse_inorder(result);
+    ASSERT_EQUAL(result.str(), "3 5 8 ");
+}
+
+TEST(rank_select) {
+    BinarySearchTree<int, std::less<int>, AvlBalance> tree;
+    for(int i = 0; i < 100; ++i)
+        tree.insert(i * 2);
+
+    ASSERT_EQUAL(tree.size(), 100);
+    ASSERT_EQUAL(tree.rank(0), 0);
+    ASSERT_EQUAL(tree.rank(1), 1);
+    ASSERT_EQUAL(tree.rank(50), 25);
+    ASSERT_EQUAL(tree.rank(1000), 100);
+
+    ASSERT_EQUAL(*tree.select(0), 0);
+    ASSERT_EQUAL(*tree.select(37), 74);
+    ASSERT_EQUAL(*tree.select(99), 198);
+    ASSERT_EQUAL(tree.select(100), tree.end());
+
+    for(int i = 0; i < 100; ++i)
+        ASSERT_EQUAL(tree.rank(*tree.select(i)), i);
+}
+
+TEST(count_range) {
+    BinarySearchTree<int> tree;
+    tree.insert(10);
+    tree.insert(5);
+    tree.insert(15);
+    tree.insert(12);
+    tree.insert(20);
+
+    ASSERT_EQUAL(tree.count_range(5, 15), 3);
+    ASSERT_EQUAL(tree.count_range(6, 16), 3);
+    ASSERT_EQUAL(tree.count_range(0, 100), 5);
+    ASSERT_EQUAL(tree.count_range(15, 5), 0);
+    ASSERT_EQUAL(tree.count_range(13, 14), 0);
+}
+
+TEST(size_after_copy) {
+    BinarySearchTree<int, std::less<int>, AvlBalance> tree;
+    for(int i = 0; i < 50; ++i)
+        tree.insert(i);
+
+    BinarySearchTree<int, std::less<int>, AvlBalance> tree_2(tree);
+    ASSERT_EQUAL(tree_2.size(), 50);
+    ASSERT_EQUAL(*tree_2.select(25), 25);
+    ASSERT_EQUAL(tree_2.rank(25), 25);
+}
+
+TEST(degenerate_chain) {
+    // A sorted stream inserted at end() into a SplayBalance tree splays
+    // each new maximum to the root, leaving the old tree as its left
+    // subtree: a chain as deep as the tree is large, built in O(1) per
+    // element. (Appending to a NoBalance chain would take O(n) each, to
+    // update the sizes cached on the way up.) Every operation below must
+    // cope without recursing.
+    using Tree = BinarySearchTree<int, std::less<int>, SplayBalance>;
+    const int count = 5000000;
+    Tree tree;
+    for(int i = 0; i < count; ++i)
+        tree.insert(tree.end(), i);
+    ASSERT_EQUAL(tree.height(), count);
+
+    // Write to the copy, so the checks below run on nodes of its own
+    Tree tree_2(tree);
+    tree_2.insert(tree_2.end(), count);
+    ASSERT_EQUAL(tree_2.size(), count + 1);
+    ASSERT_EQUAL(tree_2.height(), count + 1);
+    ASSERT_EQUAL(tree.size(), count);
+    ASSERT_TRUE(tree_2.check_sorting_invariant());
+    ASSERT_EQUAL(*tree_2.max_element(), count);
+    ASSERT_EQUAL(*tree_2.min_element(), 0);
+    ASSERT_EQUAL(*tree_2.min_greater_than(count - 2), count - 1);
+
+    int expected = 0;
+    for(int e : tree_2)
+        ASSERT_EQUAL(e, expected++);
+    ASSERT_EQUAL(expected, count + 1);
+
+    // Splaying the deepest node walks the whole chain once
+    ASSERT_EQUAL(*tree_2.find(0), 0);
+    ASSERT_EQUAL(tree_2.height(), count / 2 + 2);
+    ASSERT_TRUE(tree_2.check_sorting_invariant());
+    ASSERT_EQUAL(tree.height(), count);
+
+    tree = Tree();
+    ASSERT_TRUE(tree.empty());
+}
+
+TEST(preorder_gaps) {
+    BinarySearchTree<int> tree;
+    tree.insert(10);
+    tree.insert(5);
+    tree.insert(3);
+    tree.insert(4);
+    tree.insert(20);
+    tree.insert(25);
+    tree.insert(30);
+
+    std::stringstream preorder;
+    tree.traverse_preorder(preorder);
+    ASSERT_EQUAL(preorder.str(), "10 5 3 4 20 25 30 ");
+}
+
+TEST(move_ctor) {
+    BinarySearchTree<int> tree;
+    tree.insert(5);
+    tree.insert(2);
+    tree.insert(8);
+    auto first = tree.begin();
+
+    BinarySearchTree<int> tree_2(std::move(tree));
+    ASSERT_TRUE(tree.empty());
+    ASSERT_EQUAL(tree_2.size(), 3);
+    ASSERT_EQUAL(tree_2.begin(), first);
+}
+
+TEST(move_assign) {
+    BinarySearchTree<int> tree;
+    tree.insert(5);
+    tree.insert(2);
+
+    BinarySearchTree<int> tree_2;
+    tree_2.insert(10);
+    tree_2 = std::move(tree);
+    ASSERT_TRUE(tree.empty());
+    ASSERT_EQUAL(tree_2.size(), 2);
+    ASSERT_EQUAL(*tree_2.begin(), 2);
+    ASSERT_EQUAL(tree_2.find(10), tree_2.end());
+}
+
+TEST(insert_rvalue_and_emplace) {
+    BinarySearchTree<std::string> tree;
+    std::string long_word(40, 'm');
+    const char *buffer = long_word.data();
+
+    auto it = tree.insert(std::move(long_word));
+    ASSERT_TRUE(it->data() == buffer);
+
+    tree.emplace(3, 'a');
+    tree.emplace("zebra");
+    ASSERT_EQUAL(tree.size(), 3);
+    ASSERT_EQUAL(*tree.begin(), "aaa");
+    ASSERT_EQUAL(*tree.max_element(), "zebra");
+    ASSERT_TRUE(tree.check_sorting_invariant());
+}
+
+TEST(erase_cases) {
+    BinarySearchTree<int> tree;
+    for(int e : {50, 30, 70, 20, 40, 60, 80, 35, 45, 65})
+        tree.insert(e);
+
+    // Leaf
+    ASSERT_EQUAL(tree.erase(20), 1);
+    // One child
+    ASSERT_EQUAL(tree.erase(60), 1);
+    // Two children, successor deeper in the right subtree
+    auto next = tree.erase(tree.find(30));
+    ASSERT_EQUAL(*next, 35);
+    // Two children at the root
+    ASSERT_EQUAL(tree.erase(50), 1);
+    ASSERT_EQUAL(tree.erase(50), 0);
+
+    std::stringstream result;
+    tree.traverse_inorder(result);
+    ASSERT_EQUAL(result.str(), "35 40 45 65 70 80 ");
+    ASSERT_EQUAL(tree.size(), 6);
+    ASSERT_TRUE(tree.check_sorting_invariant());
+}
+
+TEST(erase_keeps_other_iterators) {
+    BinarySearchTree<int> tree;
+    for(int e : {4, 2, 6, 1, 3, 5, 7})
+        tree.insert(e);
+
+    auto five = tree.find(5);
+    tree.erase(4);
+    ASSERT_EQUAL(*five, 5);
+    ASSERT_EQUAL(tree.find(5), five);
+}
+
+TEST(erase_range_and_clear) {
+    BinarySearchTree<int, std::less<int>, AvlBalance> tree;
+    for(int i = 0; i < 100; ++i)
+        tree.insert(i);
+
+    auto last = tree.erase(tree.find(10), tree.find(90));
+    ASSERT_EQUAL(*last, 90);
+    ASSERT_EQUAL(tree.size(), 20);
+    ASSERT_EQUAL(tree.count_range(0, 100), 20);
+    ASSERT_TRUE(tree.check_sorting_invariant());
+
+    tree.erase(tree.begin(), tree.end());
+    ASSERT_TRUE(tree.empty());
+
+    tree.insert(3);
+    tree.clear();
+    ASSERT_TRUE(tree.empty());
+    ASSERT_EQUAL(tree.begin(), tree.end());
+}
+
+TEST(avl_erase_random) {
+    BinarySearchTree<int, std::less<int>, AvlBalance> tree;
+    std::set<int> expected;
+    std::mt19937 gen(280);
+    std::uniform_int_distribution<int> key(0, 2000);
+    for(int i = 0; i < 20000; ++i) {
+        int k = key(gen);
+        if(gen() % 2) {
+            if(expected.insert(k).second)
+                tree.insert(k);
+        }
+        else {
+            ASSERT_EQUAL(tree.erase(k), expected.erase(k));
+        }
+        ASSERT_TRUE(tree.height() <= 1.44 * std::log2(tree.size() + 2));
+    }
+
+    ASSERT_EQUAL(tree.size(), expected.size());
+    ASSERT_TRUE(tree.check_sorting_invariant());
+    auto expected_it = expected.begin();
+    for(int e : tree)
+        ASSERT_EQUAL(e, *expected_it++);
+}
+
+TEST(build_sorted) {
+    for(int count : {0, 1, 2, 3, 7, 8, 100, 1023, 1024}) {
+        std::vector<int> values;
+        for(int i = 0; i < count; ++i)
+            values.push_back(i * 3);
+
+        BinarySearchTree<int, std::less<int>, AvlBalance>
+            tree(values.begin(), values.end());
+        ASSERT_EQUAL(tree.size(), count);
+        ASSERT_EQUAL(tree.height(), size_t(std::ceil(std::log2(count + 1))));
+        ASSERT_TRUE(tree.check_sorting_invariant());
+
+        int expected = 0;
+        for(int e : tree) {
+            ASSERT_EQUAL(e, expected);
+            expected += 3;
+        }
+
+        // The result is a valid AVL tree, so inserting keeps it balanced
+        tree.insert(-1);
+        ASSERT_EQUAL(*tree.begin(), -1);
+        ASSERT_TRUE(tree.height() <= 1.44 * std::log2(count + 3));
+    }
+}
+
+TEST(build_unsorted) {
+    std::vector<int> values = {5, 3, 9, 3, 1, 5};
+    BinarySearchTree<int> tree(values.begin(), values.end());
+    ASSERT_EQUAL(tree.size(), 4);
+
+    std::stringstream result;
+    tree.traverse_inorder(result);
+    ASSERT_EQUAL(result.str(), "1 3 5 9 ");
+
+    std::vector<int> sorted = {10, 20, 30};
+    tree.assign(sorted_unique, sorted.begin(), sorted.end());
+    ASSERT_EQUAL(tree.size(), 3);
+    ASSERT_EQUAL(tree.height(), 2);
+    ASSERT_EQUAL(*tree.begin(), 10);
+}
+
+TEST(set_operations) {
+    using Tree = BinarySearchTree<int, std::less<int>, AvlBalance>;
+    std::mt19937 gen(280);
+    // Large enough to fork, plus a lopsided pair and an empty side
+    for(int other_count : {12000, 50, 0}) {
+        std::set<int> a_set, b_set;
+        Tree a, b;
+        for(int i = 0; i < 20000; ++i) {
+            int k = gen() % 40000;
+            if(a_set.insert(k).second)
+                a.insert(k);
+        }
+        for(int i = 0; i < other_count; ++i) {
+            int k = gen() % 40000;
+            if(b_set.insert(k).second)
+                b.insert(k);
+        }
+
+        std::set<int> expected[3];
+        std::set_union(a_set.begin(), a_set.end(), b_set.begin(), b_set.end(),
+                       std::inserter(expected[0], expected[0].end()));
+        std::set_intersection(a_set.begin(), a_set.end(), b_set.begin(),
+                              b_set.end(),
+                              std::inserter(expected[1], expected[1].end()));
+        std::set_difference(a_set.begin(), a_set.end(), b_set.begin(),
+                            b_set.end(),
+                            std::inserter(expected[2], expected[2].end()));
+
+        Tree results[3] = {a, a, a};
+        results[0].merge(Tree(b));
+        results[1].intersection_with(Tree(b));
+        Tree consumed(b);
+        results[2].difference_with(std::move(consumed));
+        ASSERT_TRUE(consumed.empty());
+
+        for(int op = 0; op < 3; ++op) {
+            Tree &tree = results[op];
+            ASSERT_EQUAL(tree.size(), expected[op].size());
+            ASSERT_TRUE(tree.check_sorting_invariant());
+            ASSERT_TRUE(tree.height() <= 1.44 * std::log2(tree.size() + 2));
+            auto expected_it = expected[op].begin();
+            for(int e : tree)
+                ASSERT_EQUAL(e, *expected_it++);
+
+            // The result is a proper AVL tree with working parent links
+            for(int k = 0; k < 40000; k += 7)
+                tree.erase(k);
+            ASSERT_TRUE(tree.height() <= 1.44 * std::log2(tree.size() + 2));
+        }
+    }
+}
+
+TEST(bounds_match_std_set) {
+    BinarySearchTree<int, std::less<int>, AvlBalance> tree;
+    std::set<int> expected;
+    std::mt19937 gen(280);
+    for(int i = 0; i < 2000; ++i) {
+        int k = gen() % 4000;
+        if(expected.insert(k).second)
+            tree.insert(k);
+    }
+
+    for(int q = -1; q <= 4001; ++q) {
+        auto lower = tree.lower_bound(q);
+        auto expected_lower = expected.lower_bound(q);
+        ASSERT_EQUAL(lower == tree.end(), expected_lower == expected.end());
+        if(lower != tree.end())
+            ASSERT_EQUAL(*lower, *expected_lower);
+
+        auto upper = tree.upper_bound(q);
+        auto expected_upper = expected.upper_bound(q);
+        ASSERT_EQUAL(upper == tree.end(), expected_upper == expected.end());
+        if(upper != tree.end())
+            ASSERT_EQUAL(*upper, *expected_upper);
+
+        auto range = tree.equal_range(q);
+        ASSERT_EQUAL(range.first == range.second, !expected.count(q));
+    }
+
+    for(int i = 0; i < 200; ++i) {
+        int lo = gen() % 4100 - 50;
+        int hi = gen() % 4100 - 50;
+        auto expected_it = expected.lower_bound(lo);
+        size_t visited = 0;
+        for(int e : tree.range(lo, hi)) {
+            ASSERT_EQUAL(e, *expected_it++);
+            ++visited;
+        }
+        ASSERT_EQUAL(visited, tree.count_range(lo, hi));
+        ASSERT_TRUE(expected_it == expected.end() || hi <= *expected_it);
+    }
+}
+
+TEST(range_prefix) {
+    BinarySearchTree<std::string> tree;
+    for(const char *word : {"valgrind", "valid", "valgrinding", "val",
+                            "valgr", "valgs", "apple"})
+        tree.insert(word);
+
+    std::stringstream result;
+    for(const std::string &word : tree.range("valgr", "valgs"))
+        result << word << " ";
+    ASSERT_EQUAL(result.str(), "valgr valgrind valgrinding ");
+    ASSERT_TRUE(tree.range("z", "a").empty());
+}
+
+TEST(bidirectional_iteration) {
+    BinarySearchTree<int, std::less<int>, AvlBalance> tree;
+    std::set<int> expected;
+    std::mt19937 gen(280);
+    for(int i = 0; i < 1000; ++i) {
+        int k = gen() % 5000;
+        if(expected.insert(k).second)
+            tree.insert(k);
+    }
+
+    // Walking backwards from end() visits every element in reverse
+    auto it = tree.end();
+    for(auto expected_it = expected.rbegin(); expected_it != expected.rend();
+        ++expected_it)
+        ASSERT_EQUAL(*--it, *expected_it);
+    ASSERT_EQUAL(it, tree.begin());
+
+    ASSERT_TRUE(std::equal(tree.rbegin(), tree.rend(), expected.rbegin(),
+                           expected.rend()));
+    ASSERT_EQUAL(std::distance(tree.begin(), tree.end()),
+                 std::ptrdiff_t(expected.size()));
+
+    // Top three largest without touching the rest of the tree
+    std::vector<int> top(tree.rbegin(), std::next(tree.rbegin(), 3));
+    std::vector<int> expected_top(expected.rbegin(),
+                                  std::next(expected.rbegin(), 3));
+    ASSERT_TRUE(top == expected_top);
+
+    auto max = tree.max_element();
+    ASSERT_EQUAL(*std::prev(max), *std::prev(expected.end(), 2));
+    auto copy = max--;
+    ASSERT_EQUAL(*copy, *expected.rbegin());
+    ASSERT_EQUAL(*++max, *copy);
+
+    BinarySearchTree<int> empty;
+    ASSERT_TRUE(empty.rbegin() == empty.rend());
+}
+
+TEST(serialize_round_trip) {
+    BinarySearchTree<int, std::less<int>, AvlBalance> tree;
+    for(int e : {40, -7, 12, 99, 0, 5})
+        tree.insert(e);
+
+    std::stringstream buffer;
+    tree.serialize(buffer);
+    BinarySearchTree<int, std::less<int>, AvlBalance> copy;
+    copy.insert(1000);
+    copy.deserialize(buffer);
+
+    ASSERT_EQUAL(copy.size(), 6);
+    ASSERT_EQUAL(copy.height(), 3);
+    std::stringstream result;
+    copy.traverse_inorder(result);
+    ASSERT_EQUAL(result.str(), "-7 0 5 12 40 99 ");
+
+    BinarySearchTree<std::string> words;
+    for(const char *word : {"pear", "", "apple", "fig"})
+        words.insert(word);
+    std::stringstream word_buffer;
+    words.serialize(word_buffer);
+    BinarySearchTree<std::string> word_copy;
+    word_copy.deserialize(word_buffer);
+    ASSERT_TRUE(std::equal(words.begin(), words.end(), word_copy.begin(),
+                           word_copy.end()));
+}
+
+TEST(hinted_insert) {
+    BinarySearchTree<int, std::less<int>, AvlBalance> tree;
+    std::set<int> expected;
+
+    // A sorted stream, each key inserted at end()
+    for(int i = 0; i < 1000; i += 2) {
+        auto it = tree.insert(tree.end(), i);
+        ASSERT_EQUAL(*it, i);
+        expected.insert(i);
+    }
+    ASSERT_EQUAL(tree.height(), 9);
+
+    // Right and wrong hints for random keys
+    std::mt19937 gen(280);
+    for(int i = 0; i < 2000; ++i) {
+        int k = gen() % 2000;
+        if(expected.count(k))
+            continue;
+        auto hint = (i % 2) ? tree.lower_bound(k) : tree.find(gen() % 1000);
+        auto it = tree.insert(hint, k);
+        ASSERT_EQUAL(*it, k);
+        expected.insert(k);
+    }
+    ASSERT_TRUE(tree.check_sorting_invariant());
+    ASSERT_EQUAL(tree.size(), expected.size());
+    ASSERT_TRUE(std::equal(tree.begin(), tree.end(), expected.begin()));
+
+    // Hinted inserts into a copy leave the original alone
+    auto copy = tree;
+    copy.emplace_hint(copy.begin(), -1);
+    ASSERT_EQUAL(*copy.begin(), -1);
+    ASSERT_EQUAL(*tree.begin(), 0);
+    ASSERT_EQUAL(copy.size(), tree.size() + 1);
+}
+
+TEST(find_from_finger) {
+    BinarySearchTree<int> tree;
+    std::mt19937 gen(280);
+    for(int i = 0; i < 500; ++i) {
+        int k = gen() % 1000 * 2;
+        if(!tree.contains(k))
+            tree.insert(k);
+    }
+
+    const auto &const_tree = tree;
+    for(int i = 0; i < 1000; ++i) {
+        auto finger = const_tree.select(gen() % tree.size());
+        int k = gen() % 2002 - 1;
+        ASSERT_EQUAL(const_tree.find_from(finger, k), const_tree.find(k));
+    }
+    int smallest = *tree.begin();
+    ASSERT_EQUAL(*tree.find_from(tree.end(), smallest), smallest);
+    ASSERT_EQUAL(tree.find_from(tree.end(), smallest + 1), tree.end());
+}
+
+TEST(splay_random) {
+    BinarySearchTree<int, std::less<int>, SplayBalance> tree;
+    std::set<int> expected;
+    std::mt19937 gen(280);
+    std::uniform_int_distribution<int> key(0, 2000);
+    for(int i = 0; i < 20000; ++i) {
+        int k = key(gen);
+        switch(gen() % 3) {
+        case 0:
+            if(expected.insert(k).second)
+                tree.insert(k);
+            break;
+        case 1:
+            ASSERT_EQUAL(tree.erase(k), expected.erase(k));
+            break;
+        default:
+            ASSERT_EQUAL(tree.contains(k), expected.count(k) == 1);
+        }
+    }
+
+    ASSERT_EQUAL(tree.size(), expected.size());
+    ASSERT_TRUE(tree.check_sorting_invariant());
+    auto expected_it = expected.begin();
+    for(int e : tree)
+        ASSERT_EQUAL(e, *expected_it++);
+    ASSERT_EQUAL(tree.rank(*tree.select(100)), 100);
+}
+
+TEST(splay_moves_found_to_root) {
+    BinarySearchTree<int, std::less<int>, SplayBalance> tree;
+    for(int i = 0; i < 100; ++i)
+        tree.insert(i);
+    // Sorted insertion leaves a chain, each new maximum splayed to the top
+    ASSERT_EQUAL(tree.height(), 100);
+
+    auto it = tree.find(0);
+    std::stringstream preorder;
+    tree.traverse_preorder(preorder);
+    ASSERT_EQUAL(preorder.str().substr(0, 2), "0 ");
+    ASSERT_TRUE(tree.height() < 60);
+    ASSERT_EQUAL(*++it, 1);
+
+    // A miss splays the last node visited
+    tree.erase(50);
+    ASSERT_FALSE(tree.contains(50));
+    preorder.str("");
+    tree.traverse_preorder(preorder);
+    std::string top = preorder.str().substr(0, 3);
+    ASSERT_TRUE(top == "49 " || top == "51 ");
+
+    // Splaying a copy leaves the original where it was
+    auto copy = tree;
+    std::as_const(copy).find(0);
+    std::stringstream original_preorder;
+    tree.traverse_preorder(original_preorder);
+    ASSERT_EQUAL(original_preorder.str(), preorder.str());
+
+    // lower_bound splays a hit, and for a miss the last node visited
+    ASSERT_EQUAL(*tree.lower_bound(80), 80);
+    preorder.str("");
+    tree.traverse_preorder(preorder);
+    ASSERT_EQUAL(preorder.str().substr(0, 3), "80 ");
+    ASSERT_EQUAL(*tree.lower_bound(50), 51);
+    preorder.str("");
+    tree.traverse_preorder(preorder);
+    top = preorder.str().substr(0, 3);
+    ASSERT_TRUE(top == "49 " || top == "51 ");
+    ASSERT_TRUE(tree.lower_bound(100) == tree.end());
+    preorder.str("");
+    tree.traverse_preorder(preorder);
+    ASSERT_EQUAL(preorder.str().substr(0, 3), "99 ");
+}
+
+TEST(string_prefix_cache) {
+    // Keys that share 8-byte prefixes, differ only in length, hold zero
+    // bytes or bytes above 127, where a signed char compare would go wrong
+    std::vector<std::string> keys = {
+        "", "a", std::string("a\0", 2), std::string("a\0b", 3), "ab",
+        "abcdefgh", "abcdefghi", "abcdefgh\x01", "abcdefgg\xff",
+        "\x7f", "\x80", "\xff\xff", "zzzzzzzzzzzzzzzzzzzz", "zz"
+    };
+    std::mt19937 gen(280);
+    for(int i = 0; i < 300; ++i) {
+        std::string key;
+        size_t length = gen() % 12;
+        for(size_t j = 0; j < length; ++j)
+            key += static_cast<char>("ab\0\xff"[gen() % 4]);
+        keys.push_back(key);
+    }
+
+    BinarySearchTree<std::string, std::less<std::string>, AvlBalance> tree;
+    BinarySearchTree<std::string, std::less<>, SplayBalance> transparent;
+    std::set<std::string> expected;
+    for(const std::string &key : keys) {
+        if(expected.insert(key).second) {
+            tree.insert(key);
+            transparent.insert(key);
+        }
+    }
+    ASSERT_TRUE(tree.check_sorting_invariant());
+    ASSERT_TRUE(std::equal(tree.begin(), tree.end(), expected.begin()));
+    ASSERT_TRUE(std::equal(transparent.begin(), transparent.end(),
+                           expected.begin()));
+
+    for(const std::string &key : keys) {
+        std::string missing = key + "\x01";
+        ASSERT_EQUAL(*tree.find(key), key);
+        ASSERT_EQUAL(*transparent.find(std::string_view(key)), key);
+        ASSERT_EQUAL(tree.contains(missing), expected.count(missing) == 1);
+        auto lower = tree.lower_bound(missing);
+        auto expected_lower = expected.lower_bound(missing);
+        ASSERT_EQUAL(lower == tree.end(), expected_lower == expected.end());
+        if(lower != tree.end())
+            ASSERT_EQUAL(*lower, *expected_lower);
+    }
+    ASSERT_TRUE(transparent.contains("zz"));
+    ASSERT_FALSE(transparent.contains("zzz"));
+}
+
+TEST(print_tree_limits) {
+    BinarySearchTree<int> small;
+    for(int k : {2, 1, 3, 4})
+        small.insert(k);
+    std::ostringstream top;
+    small.print_tree(top, 2);
+    // 4 is cut off and drawn as ".."
+    ASSERT_EQUAL(top.str(), "\n"
+                 "         2          \n"
+                 "       /  \\         \n"
+                 "    1       3       \n"
+                 "   /  \\    /  \\     \n"
+                 "              ..    \n"
+                 "             /  \\   \n"
+                 "                    ");
+    ASSERT_EQUAL(small.to_string().find(".."), std::string::npos);
+
+    // A chain 100000 deep, which to_string() used to lay out in full
+    BinarySearchTree<int, std::less<int>, SplayBalance> chain;
+    for(int i = 0; i < 100000; ++i)
+        chain.insert(i);
+    ASSERT_EQUAL(chain.height(), 100000);
+    std::ostringstream out;
+    chain.print_tree(out, 1000, 80);
+    std::string drawing = out.str();
+    ASSERT_TRUE(drawing.size() < 80 * 40);
+    ASSERT_NOT_EQUAL(drawing.find("99999"), std::string::npos);
+    ASSERT_NOT_EQUAL(drawing.find("..."), std::string::npos);
+    std::istringstream lines(drawing);
+    std::string line;
+    while(std::getline(lines, line))
+        ASSERT_TRUE(line.size() <= 80);
+    ASSERT_TRUE(chain.to_string().size() < 256 * 40);
+}
+
+TEST(copies_are_independent) {
+    struct PairFirstLess {
+        bool operator()(const std::pair<int, int> &a,
+                        const std::pair<int, int> &b) const {
+            return a.first < b.first;
+        }
+    };
+    using Tree = BinarySearchTree<std::pair<int, int>, PairFirstLess,
+                                  AvlBalance>;
+    Tree original;
+    for (int i = 0; i < 100; ++i) {
+        original.insert({i, i});
+    }
+
+    // Iterators into the original stay valid across a copy
+    auto first = original.begin();
+    auto middle = original.find({50, 0});
+    Tree copy = original;
+    ASSERT_TRUE(first == original.begin());
+    ASSERT_EQUAL(middle->second, 50);
+    ASSERT_NOT_EQUAL(&*std::as_const(copy).begin(), &*first);
+
+    // Writing through the const find of either tree stays in that tree
+    const Tree &const_copy = copy;
+    const_copy.find({50, 0})->second = -1;
+    ASSERT_EQUAL(middle->second, 50);
+    middle->second = -2;
+    ASSERT_EQUAL(const_copy.find({50, 0})->second, -1);
+
+    // Assignment copies too, and the copies outlive the original
+    Tree assigned;
+    assigned.insert({-5, -5});
+    assigned = original;
+    original.clear();
+    ASSERT_EQUAL(assigned.size(), 100);
+    ASSERT_EQUAL(copy.size(), 100);
+    ASSERT_EQUAL(assigned.find({50, 0})->second, -2);
+    for (auto &entry : assigned) {
+        entry.second = 0;
+    }
+    ASSERT_EQUAL(copy.find({20, 0})->second, 20);
+    ASSERT_TRUE(assigned.check_sorting_invariant());
+}
+
+TEST(sampled_invariant_check) {
+    BinarySearchTree<int, std::less<int>, AvlBalance> tree;
+    ASSERT_TRUE(tree.check_sorting_invariant(10));
+    for (int i = 0; i < 3; ++i) {
+        tree.insert(i * 10);
+    }
+    ASSERT_TRUE(tree.check_sorting_invariant(100));
+
+    // Break the ordering through an Iterator, as the WARNING on
+    // Iterator::operator* describes
+    *tree.find(0) = 25;
+    ASSERT_FALSE(tree.check_sorting_invariant());
+    ASSERT_FALSE(tree.check_sorting_invariant(100));
+}
+
+TEST(invariant_check_timing) {
+    std::vector<int> values(1000000);
+    for (size_t i = 0; i < values.size(); ++i) {
+        values[i] = static_cast<int>(i);
+    }
+    BinarySearchTree<int> tree(sorted_unique, values.begin(), values.end());
+
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_TRUE(tree.check_sorting_invariant());
+    auto full = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    ASSERT_TRUE(tree.check_sorting_invariant(1000));
+    auto sampled = std::chrono::steady_clock::now() - start;
+
+    // Generous bounds, so that sanitizer builds pass too
+    ASSERT_TRUE(full < std::chrono::seconds(5));
+    ASSERT_TRUE(sampled < full);
+}
+
+TEST(depth_histogram) {
+    // A perfect tree of 7 elements: 1 + 2 + 4 nodes
+    std::vector<int> values = {1, 2, 3, 4, 5, 6, 7};
+    BinarySearchTree<int> tree(sorted_unique, values.begin(), values.end());
+    std::vector<size_t> counts = tree.depth_histogram();
+    ASSERT_EQUAL(counts.size(), 3);
+    ASSERT_EQUAL(counts[0], 1);
+    ASSERT_EQUAL(counts[1], 2);
+    ASSERT_EQUAL(counts[2], 4);
+    ASSERT_ALMOST_EQUAL(tree.average_path_length(), 17.0 / 7, 1e-9);
+
+    // A chain of 4 elements, one per level
+    BinarySearchTree<int> chain;
+    for (int i = 0; i < 4; ++i) {
+        chain.insert(i);
+    }
+    ASSERT_TRUE(chain.depth_histogram() == std::vector<size_t>(4, 1));
+    ASSERT_ALMOST_EQUAL(chain.average_path_length(), 2.5, 1e-9);
+
+    ASSERT_TRUE(BinarySearchTree<int>().depth_histogram().empty());
+    std::ostringstream report;
+    BinarySearchTree<int>().print_stats(report);
+    ASSERT_TRUE(report.str().find("size 0") != std::string::npos);
+}
+
+#ifdef BST_INSTRUMENTATION
+TEST(instrumentation_counts) {
+    BinarySearchTree<int, std::less<int>, AvlBalance> tree;
+    for (int i = 0; i < 100; ++i) {
+        tree.insert(i);
+    }
+    ASSERT_EQUAL(tree.stats().allocations, 100);
+    ASSERT_TRUE(tree.stats().rotations > 0);
+
+    tree.reset_stats();
+    ASSERT_TRUE(tree.contains(42));
+    const TreeStats &stats = tree.stats();
+    ASSERT_EQUAL(stats.searches, 1);
+    ASSERT_TRUE(stats.node_visits >= 1 && stats.node_visits <= tree.height());
+    ASSERT_TRUE(stats.comparisons >= stats.node_visits);
+    ASSERT_EQUAL(stats.allocations, 0);
+    ASSERT_EQUAL(stats.rotations, 0);
+
+    // A copy counts its own work
+    auto copy = tree;
+    copy.insert(100);
+    ASSERT_EQUAL(copy.stats().allocations, 101);
+    ASSERT_EQUAL(tree.stats().allocations, 0);
+}
+
+TEST(instrumentation_skips_assertions) {
+    // The checks that an inserted element is new neither splay nor count,
+    // so debug builds report what NDEBUG builds do
+    BinarySearchTree<int, std::less<int>, SplayBalance> tree;
+    for (int i = 0; i < 100; i += 2) {
+        tree.insert(i);
+    }
+    tree.reset_stats();
+    tree.insert(51);
+    ASSERT_EQUAL(tree.stats().searches, 1);
+    tree.emplace(53);
+    ASSERT_EQUAL(tree.stats().searches, 2);
+    tree.emplace_hint(tree.begin(), 55);
+    ASSERT_EQUAL(tree.stats().searches, 3);
+}
+#endif
+
+// Returns whether reading 'bytes' into 'tree' throws serialize_exception
+template <typename Tree>
+static bool deserialize_throws(Tree &tree, const std::string &bytes) {
+    std::stringstream in(bytes);
+    try {
+        tree.deserialize(in);
+    }
+    catch(const serialize_exception &) {
+        return true;
+    }
+    return false;
+}
+
+TEST(deserialize_rejects_bad_input) {
+    BinarySearchTree<std::string> words;
+    words.insert("kept");
+    words.insert("also kept");
+    std::stringstream bytes;
+    words.serialize(bytes);
+    std::string image = bytes.str();
+
+    ASSERT_TRUE(deserialize_throws(words, image.substr(0, image.size() - 1)));
+    ASSERT_TRUE(deserialize_throws(words, "not a tree at all, clearly"));
+    BinarySearchTree<int> numbers;
+    ASSERT_TRUE(deserialize_throws(numbers, image));
+
+    ASSERT_EQUAL(words.size(), 2);
+    ASSERT_TRUE(words.contains("kept"));
+}
+
+// Returns an image of string elements with the given string pool and
+// record words, written by hand so it can be corrupt. 'count' overrides
+// the number of elements in the header.
+static std::string string_image(const std::string &pool,
+                                const std::vector<uint64_t> &words,
+                                uint64_t count) {
+    char header[serial_header_size] = {};
+    std::memcpy(header, serial_magic, sizeof(serial_magic));
+    serial_put(header + 4, serial_version, 4);
+    serial_put(header + 8, count, 8);
+    serial_put(header + 16, pool.size(), 8);
+    serial_put(header + 24, 1, 4);
+    header[28] = serial_string;
+    std::string image(header, serial_header_size);
+    image += pool;
+    image.resize(serial_records_offset(pool.size()), '\0');
+    for (uint64_t word : words) {
+        char bytes[8];
+        serial_put(bytes, word, 8);
+        image.append(bytes, 8);
+    }
+    return image;
+}
+
+// Returns the record word of a string at 'offset' in the pool
+static uint64_t string_word(uint64_t offset, uint64_t length) {
+    return offset | length << 32;
+}
+
+TEST(deserialize_checks_strings) {
+    BinarySearchTree<std::string> words;
+    words.insert("kept");
+
+    std::string good = string_image("abcdef", {string_word(0, 3),
+                                               string_word(3, 3)}, 2);
+    BinarySearchTree<std::string> read;
+    std::stringstream in(good);
+    read.deserialize(in);
+    ASSERT_EQUAL(read.size(), 2);
+    ASSERT_TRUE(read.contains("def"));
+
+    // A pool cut short of the last string
+    std::string truncated_pool = string_image("abcdef", {string_word(0, 3),
+                                                         string_word(3, 5)},
+                                              2);
+    ASSERT_TRUE(deserialize_throws(words, truncated_pool));
+
+    // A string starting past the end of the pool
+    std::string bad_offset = string_image("abcdef", {string_word(0, 3),
+                                                     string_word(100, 1)},
+                                          2);
+    ASSERT_TRUE(deserialize_throws(words, bad_offset));
+
+    // The view checks strings as it decodes them, too
+    SerialView<std::string> view(bad_offset.data(), bad_offset.size());
+    ASSERT_EQUAL(view.element(0), "abc");
+    bool threw = false;
+    try {
+        view.element(1);
+    }
+    catch (const serialize_exception &) {
+        threw = true;
+    }
+    ASSERT_TRUE(threw);
+
+    ASSERT_EQUAL(words.size(), 1);
+    ASSERT_TRUE(words.contains("kept"));
+}
+
+TEST(deserialize_rejects_huge_headers) {
+    BinarySearchTree<std::string> words;
+    words.insert("kept");
+
+    // Headers claiming far more data than the stream holds throw
+    // serialize_exception before allocating for it
+    std::string image = string_image("abc", {string_word(0, 3)}, 1);
+    std::string many = string_image("abc", {string_word(0, 3)},
+                                    uint64_t(1) << 40);
+    std::string too_many = string_image("abc", {string_word(0, 3)},
+                                        uint64_t(1) << 62);
+    std::string huge_pool = image;
+    serial_put(&huge_pool[16], UINT64_MAX, 8);
+    ASSERT_TRUE(deserialize_throws(words, many));
+    ASSERT_TRUE(deserialize_throws(words, too_many));
+    ASSERT_TRUE(deserialize_throws(words, huge_pool));
+
+    ASSERT_EQUAL(words.size(), 1);
+    ASSERT_TRUE(words.contains("kept"));
+}
+
 TEST_MAIN()
@@ -0,0 +1,382 @@
+#ifndef CONCURRENT_MAP_HPP
+#define CONCURRENT_MAP_HPP
+/* ConcurrentMap.hpp
+ *
+ * An ordered map of key-value pairs with unique keys that many threads
+ * can read and insert into at once without a lock. It offers the Map
+ * interface for lookups and insertion (find, operator[], insert,
+ * try_emplace, ordered begin/end iteration) plus fetch_add for counters.
+ *
+ * It is a lock-free skip list: every element sits on the bottom list,
+ * and a random quarter of them also on the next list up, and so on, so a
+ * search skips ahead in O(log n) expected steps. Inserting links the new
+ * node into each list with a compare-and-swap, bottom first.
+ *
+ * Example (counting words on several threads):
+ *   ConcurrentMap<std::string, std::atomic<int>> counts;
+ *   counts.fetch_add(word, 1); // from any thread
+ */
+
+#include <atomic>     //atomic
+#include <cassert>    //assert
+#include <cstddef>    //size_t
+#include <functional> //less, hash
+#include <new>        //operator new, placement new, launder
+#include <random>     //minstd_rand
+#include <thread>     //this_thread
+#include <tuple>      //forward_as_tuple
+#include <utility>    //pair, forward, piecewise_construct
+
+template <typename Key_type, typename Value_type,
+          typename Key_compare=std::less<Key_type> // default argument
+         >
+class ConcurrentMap {
+
+  // OVERVIEW: Elements are never removed while the map is shared, so a
+  //           reader can never reach a freed node and no memory
+  //           reclamation scheme is needed. find, contains, count,
+  //           operator[], insert, try_emplace, fetch_add and iteration
+  //           may all run concurrently. clear and destruction require
+  //           that no other thread is using the map.
+  //
+  // NOTE: Concurrent insertions only synchronize the structure. To update
+  //       a value from several threads, make Value_type an atomic (e.g.
+  //       std::atomic<int>) and use fetch_add or its other members.
+
+private:
+  using Pair_type = std::pair<const Key_type, Value_type>;
+
+  // Enables an overload only when Key_compare is transparent
+  template <typename C>
+  using Transparent = typename C::is_transparent;
+
+  struct Node;
+  using Link = std::atomic<Node *>;
+
+  // A node appears on lists 0 through height - 1. Its 'height' links are
+  // stored in the same block of memory, right after it (see
+  // create_node), so a search step touches one allocation rather than
+  // two.
+  struct Node {
+    template <typename K, typename... Args>
+    Node(int height_in, Link *next_in, K &&k, Args &&... args)
+      : kv(std::piecewise_construct, std::forward_as_tuple(std::forward<K>(k)),
+           std::forward_as_tuple(std::forward<Args>(args)...)),
+        height(height_in), next(next_in) { }
+
+    Pair_type kv;
+    int height;
+    Link *next;
+  };
+
+  // Where a node's links start within its block
+  static const size_t links_offset
+    = (sizeof(Node) + alignof(Link) - 1) / alignof(Link) * alignof(Link);
+
+  // Enough lists for about 4^max_level elements
+  static const int max_level = 16;
+
+public:
+
+  class Iterator {
+    // OVERVIEW: Walks the bottom list in key order. Elements inserted
+    //           concurrently may or may not be visited.
+
+  public:
+    Iterator()
+      : current_node(nullptr) { }
+
+    Pair_type &operator*() const {
+      return current_node->kv;
+    }
+
+    Pair_type *operator->() const {
+      return &current_node->kv;
+    }
+
+    // Prefix ++
+    Iterator &operator++() {
+      current_node = current_node->next[0].load(std::memory_order_acquire);
+      return *this;
+    }
+
+    // Postfix ++ (implemented in terms of prefix ++)
+    Iterator operator++(int) {
+      Iterator result(*this);
+      ++(*this);
+      return result;
+    }
+
+    bool operator==(const Iterator &rhs) const {
+      return current_node == rhs.current_node;
+    }
+
+    bool operator!=(const Iterator &rhs) const {
+      return current_node != rhs.current_node;
+    }
+
+  private:
+    friend class ConcurrentMap;
+
+    Node *current_node;
+
+    explicit Iterator(Node *node)
+      : current_node(node) { }
+  };
+
+  // Default constructor
+  ConcurrentMap()
+    : head(), num_elements(0) { }
+
+  // A ConcurrentMap may hold atomics, and copying one that other threads
+  // are inserting into could not be done safely, so it cannot be copied
+  ConcurrentMap(const ConcurrentMap &other) = delete;
+  ConcurrentMap &operator=(const ConcurrentMap &rhs) = delete;
+
+  // Destructor
+  ~ConcurrentMap() {
+    clear();
+  }
+
+  // EFFECTS : Returns whether this ConcurrentMap is empty.
+  bool empty() const {
+    return size() == 0;
+  }
+
+  // EFFECTS : Returns the number of elements whose insertion has
+  //           completed.
+  size_t size() const {
+    return num_elements.load(std::memory_order_relaxed);
+  }
+
+  // EFFECTS : Returns an Iterator to the element with key k, or an end
+  //           Iterator if there is none.
+  Iterator find(const Key_type &k) const {
+    return find_key(k);
+  }
+
+  // EFFECTS : Same as above, for any type a transparent Key_compare can
+  //           compare with Key_type.
+  template <typename K, typename C = Key_compare, typename = Transparent<C>>
+  Iterator find(const K &k) const {
+    return find_key(k);
+  }
+
+  // EFFECTS : Returns whether this ConcurrentMap holds an element with
+  //           key k.
+  bool contains(const Key_type &k) const {
+    return find(k) != end();
+  }
+
+  // EFFECTS : Same as above, for a transparent Key_compare.
+  template <typename K, typename C = Key_compare, typename = Transparent<C>>
+  bool contains(const K &k) const {
+    return find(k) != end();
+  }
+
+  // EFFECTS : Returns the number of elements with key k (0 or 1).
+  size_t count(const Key_type &k) const {
+    return contains(k) ? 1 : 0;
+  }
+
+  // EFFECTS : Same as above, for a transparent Key_compare.
+  template <typename K, typename C = Key_compare, typename = Transparent<C>>
+  size_t count(const K &k) const {
+    return contains(k) ? 1 : 0;
+  }
+
+  // MODIFIES: this
+  // EFFECTS : Returns a reference to the value for key k, inserting a
+  //           value-initialized one first if k is not present. The
+  //           reference stays valid until the map is cleared.
+  Value_type &operator[](const Key_type &k) {
+    return try_emplace(k).first->second;
+  }
+
+  // MODIFIES: this
+  // EFFECTS : Same as above, for a transparent Key_compare. A Key_type is
+  //           only constructed from k if a new element has to be
+  //           inserted.
+  template <typename K, typename C = Key_compare, typename = Transparent<C>>
+  Value_type &operator[](const K &k) {
+    Iterator it = find(k);
+    if (it != end()) {
+      return it->second;
+    }
+    return try_emplace(Key_type(k)).first->second;
+  }
+
+  // REQUIRES: Value_type is a std::atomic of an arithmetic type
+  // MODIFIES: this
+  // EFFECTS : Atomically adds 'delta' to the value for key k, inserting a
+  //           zero value first if k is not present. Returns the value
+  //           held just before the addition.
+  template <typename K, typename Delta>
+  auto fetch_add(const K &k, Delta delta) {
+    return (*this)[k].fetch_add(delta);
+  }
+
+  // MODIFIES: this
+  // EFFECTS : Inserts a copy of val if its key is not already present.
+  //           Returns an Iterator to the element with that key, along with
+  //           whether val was inserted.
+  std::pair<Iterator, bool> insert(const std::pair<Key_type, Value_type> &val) {
+    return try_emplace(val.first, val.second);
+  }
+
+  // MODIFIES: this
+  // EFFECTS : If k is not present, inserts an element with key k and a
+  //           value constructed in place from args. Returns an Iterator to
+  //           the element with key k, along with whether it was inserted.
+  //           If another thread inserts k at the same time, exactly one of
+  //           the two insertions succeeds.
+  template <typename K, typename... Args>
+  std::pair<Iterator, bool> try_emplace(K &&k, Args &&... args) {
+    std::atomic<Node *> *preds[max_level];
+    Node *succs[max_level];
+    Node *found = search(k, preds, succs);
+    if (found && !less(k, found->kv.first)) {
+      return {Iterator(found), false};
+    }
+
+    Node *node = create_node(random_height(), std::forward<K>(k),
+                             std::forward<Args>(args)...);
+    const Key_type &key = node->kv.first;
+
+    // Linking the bottom list is what makes the element visible, so if
+    // that fails because the neighbours changed, look again for the key
+    while (!link(node, 0, preds, succs)) {
+      found = search(key, preds, succs);
+      if (found && !less(key, found->kv.first)) {
+        free_node(node);
+        return {Iterator(found), false};
+      }
+    }
+    for (int level = 1; level < node->height; ++level) {
+      while (!link(node, level, preds, succs)) {
+        search(key, preds, succs);
+      }
+    }
+    num_elements.fetch_add(1, std::memory_order_relaxed);
+    return {Iterator(node), true};
+  }
+
+  // REQUIRES: no other thread is using this ConcurrentMap
+  // MODIFIES: this
+  // EFFECTS : Removes every element.
+  void clear() {
+    Node *node = head[0].load(std::memory_order_relaxed);
+    while (node) {
+      Node *next = node->next[0].load(std::memory_order_relaxed);
+      free_node(node);
+      node = next;
+    }
+    for (std::atomic<Node *> &link : head) {
+      link.store(nullptr, std::memory_order_relaxed);
+    }
+    num_elements.store(0, std::memory_order_relaxed);
+  }
+
+  // EFFECTS : Returns an Iterator to the first key-value pair.
+  Iterator begin() const {
+    return Iterator(head[0].load(std::memory_order_acquire));
+  }
+
+  // EFFECTS : Returns an Iterator to "past-the-end".
+  Iterator end() const {
+    return Iterator();
+  }
+
+private:
+  // The first node on each list. It is mutable because search() hands
+  // out pointers to these links for insertions to swap.
+  mutable std::atomic<Node *> head[max_level];
+  std::atomic<size_t> num_elements;
+  Key_compare less;
+
+  // MODIFIES: preds, succs
+  // EFFECTS : Returns the first node whose key is not less than k, or a
+  //           null pointer. For each list, stores the links of the last
+  //           node (or the head) before k in preds and the node after it
+  //           in succs.
+  template <typename K>
+  Node *search(const K &k, std::atomic<Node *> **preds, Node **succs) const {
+    std::atomic<Node *> *links = head;
+    Node *next = nullptr;
+    for (int level = max_level - 1; level >= 0; --level) {
+      next = links[level].load(std::memory_order_acquire);
+      while (next && less(next->kv.first, k)) {
+        links = next->next;
+        next = links[level].load(std::memory_order_acquire);
+      }
+      preds[level] = links;
+      succs[level] = next;
+    }
+    return next;
+  }
+
+  template <typename K>
+  Iterator find_key(const K &k) const {
+    std::atomic<Node *> *preds[max_level];
+    Node *succs[max_level];
+    Node *found = search(k, preds, succs);
+    if (found && !less(k, found->kv.first)) {
+      return Iterator(found);
+    }
+    return end();
+  }
+
+  // MODIFIES: 'node', the list at 'level'
+  // EFFECTS : Tries to splice 'node' into the list at 'level' between
+  //           preds[level] and succs[level]. Returns false, changing
+  //           nothing, if another thread changed that link first.
+  static bool link(Node *node, int level, std::atomic<Node *> **preds,
+                   Node **succs) {
+    Node *expected = succs[level];
+    node->next[level].store(expected, std::memory_order_relaxed);
+    return preds[level][level].compare_exchange_strong(
+      expected, node, std::memory_order_release, std::memory_order_relaxed);
+  }
+
+  // EFFECTS : Allocates a node followed by 'height' links, all null,
+  //           and constructs its element from k and args.
+  template <typename K, typename... Args>
+  static Node *create_node(int height, K &&k, Args &&... args) {
+    char *memory = static_cast<char *>(
+      ::operator new(links_offset + height * sizeof(Link)));
+    for (int level = 0; level < height; ++level) {
+      new (memory + links_offset + level * sizeof(Link)) Link(nullptr);
+    }
+    Link *links = std::launder(reinterpret_cast<Link *>(memory
+                                                        + links_offset));
+    try {
+      return new (memory) Node(height, links, std::forward<K>(k),
+                               std::forward<Args>(args)...);
+    }
+    catch (...) {
+      ::operator delete(memory);
+      throw;
+    }
+  }
+
+  // EFFECTS : Destroys 'node' and frees its memory. (The links are
+  //           trivially destructible, so they need no destructor call.)
+  static void free_node(Node *node) {
+    node->~Node();
+    ::operator delete(node);
+  }
+
+  // EFFECTS : Returns a random node height: 1 with probability 3/4, 2
+  //           with probability 3/16, and so on.
+  static int random_height() {
+    thread_local std::minstd_rand gen(static_cast<unsigned>(
+      std::hash<std::thread::id>()(std::this_thread::get_id())));
+    int height = 1;
+    while (height < max_level && (gen() & 3) == 0) {
+      ++height;
+    }
+    return height;
+  }
+};
+
+#endif // CONCURRENT_MAP_HPP
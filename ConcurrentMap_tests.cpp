@@ -0,0 +1,146 @@
+#include "ConcurrentMap.hpp"
+#include "unit_test_framework.hpp"
+#include <atomic>
+#include <map>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+TEST(concurrent_ctor) {
+    ConcurrentMap<std::string, int> map;
+    ASSERT_EQUAL(map.begin(), map.end());
+    ASSERT_EQUAL(map.size(), 0);
+    ASSERT_TRUE(map.empty());
+}
+
+TEST(concurrent_insert_index) {
+    ConcurrentMap<std::string, int> map;
+    ASSERT_TRUE(map.insert(std::pair<std::string, int>{"test", 5}).second);
+    ASSERT_TRUE(map.try_emplace("hello", 7).second);
+    auto res = map.try_emplace("hello", 3);
+    ASSERT_FALSE(res.second);
+    ASSERT_EQUAL(res.first->second, 7);
+
+    map["zed"] += 2;
+    map["zed"] += 2;
+    ASSERT_EQUAL(map.size(), 3);
+    ASSERT_EQUAL(map.find("zed")->second, 4);
+    ASSERT_EQUAL(map.count("nope"), 0);
+
+    auto it = map.begin();
+    ASSERT_EQUAL(it->first, "hello");
+    ASSERT_EQUAL((++it)->first, "test");
+    ASSERT_EQUAL((++it)->first, "zed");
+    ASSERT_EQUAL(++it, map.end());
+
+    map.clear();
+    ASSERT_TRUE(map.empty());
+    ASSERT_EQUAL(map.begin(), map.end());
+}
+
+TEST(concurrent_matches_std_map) {
+    ConcurrentMap<int, int> map;
+    std::map<int, int> expected;
+    std::mt19937 gen(280);
+    for (int i = 0; i < 20000; ++i) {
+        int k = gen() % 5000;
+        ASSERT_EQUAL(map.try_emplace(k, i).second,
+                     expected.emplace(k, i).second);
+    }
+    ASSERT_EQUAL(map.size(), expected.size());
+    auto it = map.begin();
+    for (const auto &kv : expected) {
+        ASSERT_EQUAL(it->first, kv.first);
+        ASSERT_EQUAL(it->second, kv.second);
+        ++it;
+    }
+    ASSERT_EQUAL(it, map.end());
+}
+
+TEST(concurrent_fetch_add_from_threads) {
+    ConcurrentMap<int, std::atomic<int>> counts;
+    const int num_threads = 4;
+    const int per_thread = 5000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&counts, t]() {
+            std::mt19937 gen(t);
+            for (int i = 0; i < per_thread; ++i) {
+                counts.fetch_add(int(gen() % 300), 1);
+            }
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    int total = 0;
+    int previous = -1;
+    for (auto &kv : counts) {
+        ASSERT_TRUE(previous < kv.first);
+        previous = kv.first;
+        total += kv.second.load();
+    }
+    ASSERT_EQUAL(total, num_threads * per_thread);
+    ASSERT_EQUAL(counts.size(), 300);
+}
+
+TEST(concurrent_insert_find_from_threads) {
+    ConcurrentMap<int, std::string> map;
+    const int num_threads = 8;
+    const int per_thread = 5000;
+    std::atomic<int> lost(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&map, &lost, t]() {
+            // Each thread inserts its own keys, interleaved with the
+            // others', and looks each one up again right away along with
+            // a key another thread may be inserting
+            for (int i = 0; i < per_thread; ++i) {
+                int k = i * num_threads + t;
+                if (!map.try_emplace(k, std::to_string(k)).second) {
+                    ++lost;
+                }
+                auto it = map.find(k);
+                if (it == map.end() || it->second != std::to_string(k)) {
+                    ++lost;
+                }
+                auto other = map.find(k + 1);
+                if (other != map.end()
+                    && other->second != std::to_string(k + 1)) {
+                    ++lost;
+                }
+            }
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    ASSERT_EQUAL(lost.load(), 0);
+    ASSERT_EQUAL(map.size(), num_threads * per_thread);
+    int expected = 0;
+    for (const auto &kv : map) {
+        ASSERT_EQUAL(kv.first, expected);
+        ASSERT_EQUAL(kv.second, std::to_string(expected));
+        ++expected;
+    }
+    ASSERT_EQUAL(expected, num_threads * per_thread);
+    for (int k = 0; k < num_threads * per_thread; ++k) {
+        ASSERT_TRUE(map.contains(k));
+    }
+}
+
+TEST(concurrent_transparent_lookup) {
+    ConcurrentMap<std::string, std::atomic<int>, std::less<>> counts;
+    std::string_view word = "apple";
+    ASSERT_EQUAL(counts.fetch_add(word, 2), 0);
+    ASSERT_EQUAL(counts.fetch_add(word, 1), 2);
+    ASSERT_TRUE(counts.contains(word));
+    ASSERT_EQUAL(counts[word].load(), 3);
+    ASSERT_EQUAL(counts.size(), 1);
+}
+
+TEST_MAIN()
@@ -0,0 +1,244 @@
+#ifndef FROZEN_TREE_HPP
+#define FROZEN_TREE_HPP
+/* FrozenTree.hpp
+ *
+ * An immutable, sorted set of elements for trees that stop changing,
+ * such as the Maps of a trained Classifier. It is made by
+ * BinarySearchTree::freeze() or Map::freeze() and offers their read-only
+ * interface: find, contains, count, lower_bound and ordered begin/end
+ * iteration.
+ *
+ * The elements sit in one array in Eytzinger (breadth-first) order: the
+ * root is at position 1 and the children of position i are at 2i and
+ * 2i + 1. A search needs no pointers, compiles to a loop without
+ * unpredictable branches, and prefetches the elements a few levels below
+ * the current one, since they lie next to each other in the array.
+ *
+ * Example:
+ *   Map<std::string, int> counts = ...;
+ *   auto frozen = counts.freeze();
+ *   auto it = frozen.find("valgrind");
+ *   if (it != frozen.end()) { int n = it->second; }
+ */
+
+#include <cstddef>    //size_t, ptrdiff_t
+#include <functional> //less
+#include <iterator>   //forward_iterator_tag, distance
+#include <vector>     //vector
+
+template <typename T,
+          typename Compare=std::less<T> // default argument
+         >
+class FrozenTree {
+
+  // OVERVIEW: Elements are stored by value in Eytzinger order; position
+  //           i (counting from 1) is stored at elements[i - 1], and
+  //           position 0 stands for "no element". Compare must order the
+  //           elements the way the tree they came from did.
+
+public:
+
+  class Iterator {
+    // OVERVIEW: Visits the elements in ascending order. Each step moves
+    //           to the in-order successor within the implicit tree, in
+    //           O(1) amortized time.
+
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T *;
+    using reference = const T &;
+
+    Iterator()
+      : tree(nullptr), position(0) { }
+
+    const T &operator*() const {
+      return tree->elements[position - 1];
+    }
+
+    const T *operator->() const {
+      return &tree->elements[position - 1];
+    }
+
+    // Prefix ++
+    Iterator &operator++() {
+      position = tree->successor(position);
+      return *this;
+    }
+
+    // Postfix ++ (implemented in terms of prefix ++)
+    Iterator operator++(int) {
+      Iterator result(*this);
+      ++(*this);
+      return result;
+    }
+
+    bool operator==(const Iterator &rhs) const {
+      return position == rhs.position;
+    }
+
+    bool operator!=(const Iterator &rhs) const {
+      return position != rhs.position;
+    }
+
+  private:
+    friend class FrozenTree;
+
+    const FrozenTree *tree;
+    size_t position;
+
+    Iterator(const FrozenTree *tree_in, size_t position_in)
+      : tree(tree_in), position(position_in) { }
+  };
+
+  // Default constructor
+  FrozenTree() { }
+
+  // REQUIRES: [first, last) is in strictly increasing order
+  // EFFECTS : Constructs a FrozenTree holding copies of the elements of
+  //           [first, last), in O(n).
+  template <typename ForwardIt>
+  FrozenTree(ForwardIt first, ForwardIt last) {
+    size_t n = static_cast<size_t>(std::distance(first, last));
+    std::vector<ForwardIt> sorted;
+    sorted.reserve(n);
+    for (; first != last; ++first) {
+      sorted.push_back(first);
+    }
+
+    // Visit the positions in order to find which element each one gets,
+    // then copy the elements in position order
+    std::vector<size_t> rank(n + 1);
+    size_t position = leftmost(1, n);
+    for (size_t i = 0; i < n; ++i) {
+      rank[position] = i;
+      position = successor(position, n);
+    }
+    elements.reserve(n);
+    for (position = 1; position <= n; ++position) {
+      elements.push_back(*sorted[rank[position]]);
+    }
+  }
+
+  // EFFECTS : Returns whether this FrozenTree is empty.
+  bool empty() const {
+    return elements.empty();
+  }
+
+  // EFFECTS : Returns the number of elements.
+  size_t size() const {
+    return elements.size();
+  }
+
+  // EFFECTS : Returns an Iterator to the first element that is not less
+  //           than 'query', or an end Iterator if there is none. 'query'
+  //           may be anything Compare can compare with T.
+  template <typename K>
+  Iterator lower_bound(const K &query) const {
+    const size_t n = size();
+    const T *base = elements.data();
+    size_t position = 1;
+    while (position <= n) {
+      size_t ahead = position * prefetch_span;
+      if (ahead <= n) {
+        prefetch(base + ahead - 1);
+      }
+      // Go right exactly when the element is less than the query
+      position = 2 * position + less(base[position - 1], query);
+    }
+    // The answer is the last node where the search went left: undo the
+    // trailing right turns, then the left turn itself
+    while (position & 1) {
+      position >>= 1;
+    }
+    position >>= 1;
+    return Iterator(this, position);
+  }
+
+  // EFFECTS : Returns an Iterator to the element equivalent to 'query',
+  //           or an end Iterator if there is none.
+  template <typename K>
+  Iterator find(const K &query) const {
+    Iterator it = lower_bound(query);
+    if (it != end() && !less(query, *it)) {
+      return it;
+    }
+    return end();
+  }
+
+  // EFFECTS : Returns whether there is an element equivalent to 'query'.
+  template <typename K>
+  bool contains(const K &query) const {
+    return find(query) != end();
+  }
+
+  // EFFECTS : Returns the number of elements equivalent to 'query'
+  //           (0 or 1).
+  template <typename K>
+  size_t count(const K &query) const {
+    return contains(query) ? 1 : 0;
+  }
+
+  // EFFECTS : Returns an Iterator to the first element.
+  Iterator begin() const {
+    return Iterator(this, leftmost(1, size()));
+  }
+
+  // EFFECTS : Returns an Iterator to "past-the-end".
+  Iterator end() const {
+    return Iterator(this, 0);
+  }
+
+private:
+  std::vector<T> elements;
+  Compare less;
+
+  // The search prefetches the first of the descendants this many
+  // positions apart, which are about one cache line of elements, two or
+  // more levels below the current position
+  static constexpr size_t prefetch_span =
+    64 / sizeof(T) >= 16 ? 16 : 64 / sizeof(T) >= 8 ? 8 : 4;
+
+  // EFFECTS : Hints that the memory at 'address' will be read soon.
+  static void prefetch(const T *address) {
+#if defined(__GNUC__)
+    __builtin_prefetch(address);
+#else
+    (void)address;
+#endif
+  }
+
+  // EFFECTS : Returns the smallest position in the subtree rooted at
+  //           'position' of an implicit tree with n positions, or 0 if
+  //           'position' is past n.
+  static size_t leftmost(size_t position, size_t n) {
+    if (position > n) {
+      return 0;
+    }
+    while (2 * position <= n) {
+      position *= 2;
+    }
+    return position;
+  }
+
+  // REQUIRES: 1 <= position <= n
+  // EFFECTS : Returns the in-order successor of 'position' in an implicit
+  //           tree with n positions, or 0 if it is the largest.
+  static size_t successor(size_t position, size_t n) {
+    if (2 * position + 1 <= n) {
+      return leftmost(2 * position + 1, n);
+    }
+    // Climb while 'position' is a right child
+    while (position & 1) {
+      position >>= 1;
+    }
+    return position >> 1;
+  }
+
+  size_t successor(size_t position) const {
+    return successor(position, size());
+  }
+};
+
+#endif // FROZEN_TREE_HPP
@@ -0,0 +1,71 @@
+#include "FrozenTree.hpp"
+#include "BinarySearchTree.hpp"
+#include "Map.hpp"
+#include "unit_test_framework.hpp"
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+TEST(frozen_empty) {
+    BinarySearchTree<int> tree;
+    FrozenTree<int> frozen = tree.freeze();
+    ASSERT_TRUE(frozen.empty());
+    ASSERT_EQUAL(frozen.size(), 0);
+    ASSERT_TRUE(frozen.begin() == frozen.end());
+    ASSERT_TRUE(frozen.find(3) == frozen.end());
+    ASSERT_TRUE(frozen.lower_bound(3) == frozen.end());
+}
+
+TEST(frozen_matches_std_set) {
+    // Every size up to a few full levels, so each tree shape is covered
+    for (int n = 1; n <= 70; ++n) {
+        std::set<int> expected;
+        BinarySearchTree<int, std::less<int>, AvlBalance> tree;
+        for (int i = 0; i < n; ++i) {
+            expected.insert(i * 2);
+            tree.insert(i * 2);
+        }
+        FrozenTree<int> frozen = tree.freeze();
+        ASSERT_EQUAL(frozen.size(), n);
+
+        auto expected_it = expected.begin();
+        for (int e : frozen) {
+            ASSERT_EQUAL(e, *expected_it++);
+        }
+        ASSERT_TRUE(expected_it == expected.end());
+
+        for (int q = -1; q <= 2 * n; ++q) {
+            auto bound = frozen.lower_bound(q);
+            auto expected_bound = expected.lower_bound(q);
+            ASSERT_EQUAL(bound == frozen.end(),
+                         expected_bound == expected.end());
+            if (bound != frozen.end()) {
+                ASSERT_EQUAL(*bound, *expected_bound);
+            }
+            ASSERT_EQUAL(frozen.contains(q), expected.count(q) == 1);
+        }
+    }
+}
+
+TEST(frozen_map) {
+    Map<std::string, int, std::less<>> counts;
+    counts["valgrind"] = 4;
+    counts["gdb"] = 2;
+    counts["make"] = 7;
+
+    Map<std::string, int, std::less<>>::Frozen frozen = counts.freeze();
+    counts["make"] = 0;
+    ASSERT_EQUAL(frozen.size(), 3);
+    ASSERT_EQUAL(frozen.find("make")->second, 7);
+    ASSERT_EQUAL(frozen.find(std::string_view("gdb"))->second, 2);
+    ASSERT_EQUAL(frozen.count(std::string("cmake")), 0);
+
+    std::vector<std::string> keys;
+    for (const auto &kv : frozen) {
+        keys.push_back(kv.first);
+    }
+    ASSERT_TRUE(keys == std::vector<std::string>({"gdb", "make", "valgrind"}));
+}
+
+TEST_MAIN()
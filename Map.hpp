@@ -17,10 +17,15 @@
 
 #include "BinarySearchTree.hpp"
 #include <cassert>  //assert
-#include <utility>  //pair
+#include <cstdint>  //uint64_t
+#include <utility>  //pair, move, forward, piecewise_construct
+#include <tuple>    //forward_as_tuple
+#include <iterator> //reverse_iterator
 
 template <typename Key_type, typename Value_type,
-          typename Key_compare=std::less<Key_type> // default argument
+          typename Key_compare=std::less<Key_type>, // default argument
+          typename Balance=NoBalance, // see BinarySearchTree.hpp
+          typename Allocator=std::allocator<std::pair<Key_type, Value_type>>
          >
 class Map {
 
@@ -30,14 +35,49 @@ private:
   // See http://www.cplusplus.com/reference/utility/pair/
   using Pair_type = std::pair<Key_type, Value_type>;
 
-  // A custom comparator
+  // A custom comparator. It only ever looks at keys, and it can also
+  // compare an element directly with a bare key (or, if Key_compare is
+  // transparent, anything Key_compare accepts), so lookups never need
+  // to build a dummy element.
   class PairComp {
   public:
+    using is_transparent = void;
+
     bool operator()(const Pair_type& a, const Pair_type& b) const {
       return Key_compare{}(a.first, b.first);
     }
+
+    template <typename K>
+    bool operator()(const Pair_type& a, const K& b) const {
+      return Key_compare{}(a.first, b);
+    }
+
+    template <typename K>
+    bool operator()(const K& a, const Pair_type& b) const {
+      return Key_compare{}(a, b.first);
+    }
+
+    // Lets the tree cache key prefixes when it would for Key_type and
+    // Key_compare (see Key_prefix in BinarySearchTree.hpp)
+    struct Prefix {
+      static constexpr bool enabled =
+        Key_prefix<Key_type, Key_compare>::enabled;
+
+      static std::uint64_t of(const Pair_type& pair) {
+        return Key_prefix<Key_type, Key_compare>::of(pair.first);
+      }
+
+      template <typename K>
+      static std::uint64_t of(const K& key) {
+        return Key_prefix<Key_type, Key_compare>::of(key);
+      }
+    };
   };
 
+  // Enables an overload only when Key_compare is transparent
+  template <typename C>
+  using Transparent = typename C::is_transparent;
+
 public:
 
   // OVERVIEW: Maps are associative containers that store elements
@@ -55,7 +95,7 @@ public:
   // Type alias for iterator type. It is sufficient to use the Iterator
   // from BinarySearchTree<Pair_type> since it will yield elements of Pair_type
   // in the appropriate order for the Map.
-  using Iterator = typename BinarySearchTree<Pair_type, PairComp>::Iterator;
+  using Iterator = typename BinarySearchTree<Pair_type, PairComp, Balance, Allocator>::Iterator;
 
   // You should add in a default constructor, destructor, copy
   // constructor, and overloaded assignment operator, if appropriate.
@@ -63,6 +103,26 @@ public:
   // you should omit them. A user of the class must be able to create,
   // copy, assign, and destroy Maps.
 
+  // Default constructor
+  Map() = default;
+
+  // Constructs an empty Map that allocates its elements from 'alloc'
+  explicit Map(const Allocator &alloc)
+    : _tree(alloc) { }
+
+  // Constructs a Map holding the key-value pairs in [first, last).
+  // If the keys are in strictly increasing order this takes O(n);
+  // see assign() below.
+  template <typename ForwardIt>
+  Map(ForwardIt first, ForwardIt last)
+    : _tree(first, last) { }
+
+  // Constructs a Map from pairs whose keys are known to be in strictly
+  // increasing order, in O(n)
+  template <typename ForwardIt>
+  Map(SortedUnique, ForwardIt first, ForwardIt last)
+    : _tree(sorted_unique, first, last) { }
+
 
   // EFFECTS : Returns whether this Map is empty.
   bool empty() const;
@@ -75,11 +135,94 @@ public:
   //           to k and returns an Iterator to the associated value if found,
   //           otherwise returns an end Iterator.
   //
-  // HINT: Since Map is implemented using a BinarySearchTree that stores
-  //       (key, value) pairs, you'll need to construct a dummy value
-  //       using "Value_type()".
+  // NOTE: The comparator compares elements with k directly, so no
+  //       dummy (key, value) pair is built.
   Iterator find(const Key_type& k) const;
 
+  // EFFECTS : Same as above, but k may be any type Key_compare can compare
+  //           with Key_type, such as a std::string_view or const char*
+  //           when the keys are std::string. Only available when
+  //           Key_compare is transparent (e.g. std::less<>), and never
+  //           constructs a Key_type.
+  template <typename K, typename C = Key_compare, typename = Transparent<C>>
+  Iterator find(const K& k) const;
+
+  // REQUIRES: finger is an iterator into this Map
+  // EFFECTS : Same as find, but starts searching from finger instead of
+  //           the root, which is faster when k is near it in key order
+  //           (see BinarySearchTree::find_from).
+  Iterator find_from(Iterator finger, const Key_type& k) const;
+
+  // EFFECTS : Same as above, for a transparent Key_compare.
+  template <typename K, typename C = Key_compare, typename = Transparent<C>>
+  Iterator find_from(Iterator finger, const K& k) const;
+
+  // EFFECTS : Returns whether this Map holds an element with key k.
+  bool contains(const Key_type& k) const;
+
+  // EFFECTS : Same as above, for a transparent Key_compare.
+  template <typename K, typename C = Key_compare, typename = Transparent<C>>
+  bool contains(const K& k) const;
+
+  // EFFECTS : Returns the number of elements with key k (0 or 1).
+  size_t count(const Key_type& k) const;
+
+  // EFFECTS : Same as above, for a transparent Key_compare.
+  template <typename K, typename C = Key_compare, typename = Transparent<C>>
+  size_t count(const K& k) const;
+
+  // EFFECTS : Returns the number of keys in this Map that are less
+  //           than k. Runs in O(log n) for a balanced Map.
+  size_t rank(const Key_type& k) const;
+
+  // EFFECTS : Returns an Iterator to the key-value pair at position n
+  //           (counting from 0) in key order, or an end Iterator if n is
+  //           not less than size().
+  Iterator select(size_t n) const;
+
+  // EFFECTS : Returns the number of keys k in this Map with lo <= k < hi.
+  size_t count_range(const Key_type& lo, const Key_type& hi) const;
+
+  // EFFECTS : Returns an Iterator to the first key-value pair whose key is
+  //           not less than k, or an end Iterator if there is none.
+  //           Runs in O(log n) for a balanced Map.
+  Iterator lower_bound(const Key_type& k) const;
+
+  // EFFECTS : Same as above, for a transparent Key_compare.
+  template <typename K, typename C = Key_compare, typename = Transparent<C>>
+  Iterator lower_bound(const K& k) const;
+
+  // EFFECTS : Returns an Iterator to the first key-value pair whose key is
+  //           greater than k, or an end Iterator if there is none.
+  //           Runs in O(log n) for a balanced Map.
+  Iterator upper_bound(const Key_type& k) const;
+
+  // EFFECTS : Same as above, for a transparent Key_compare.
+  template <typename K, typename C = Key_compare, typename = Transparent<C>>
+  Iterator upper_bound(const K& k) const;
+
+  // EFFECTS : Returns {lower_bound(k), upper_bound(k)}, the range holding
+  //           the key-value pair with key k if there is one.
+  std::pair<Iterator, Iterator> equal_range(const Key_type& k) const;
+
+  // EFFECTS : Same as above, for a transparent Key_compare.
+  template <typename K, typename C = Key_compare, typename = Transparent<C>>
+  std::pair<Iterator, Iterator> equal_range(const K& k) const;
+
+  // Type alias for a pair of Iterators that can be used in a range-based
+  // for loop
+  using Range = typename BinarySearchTree<Pair_type, PairComp, Balance, Allocator>::Range;
+
+  // EFFECTS : Returns the key-value pairs with lo <= key < hi, in key
+  //           order, without visiting any other pairs. For example, with
+  //           std::string keys, map.range("valgr", "valgs") holds every
+  //           key starting with "valgr".
+  Range range(const Key_type& lo, const Key_type& hi) const;
+
+  // EFFECTS : Same as above, for a transparent Key_compare.
+  template <typename K, typename C = Key_compare, typename = Transparent<C>>
+  Range range(const K& lo, const K& hi) const;
+
   // MODIFIES: this
   // EFFECTS : Returns a reference to the mapped value for the given
   //           key. If k matches the key of an element in the
@@ -98,6 +241,18 @@ public:
   // HINT: http://www.cplusplus.com/reference/map/map/operator[]/
   Value_type& operator[](const Key_type& k);
 
+  // MODIFIES: this
+  // EFFECTS : Same as above, but moves k into the new element if one is
+  //           inserted.
+  Value_type& operator[](Key_type&& k);
+
+  // MODIFIES: this
+  // EFFECTS : Same as above, for a transparent Key_compare. A Key_type is
+  //           only constructed from k if a new element has to be
+  //           inserted.
+  template <typename K, typename C = Key_compare, typename = Transparent<C>>
+  Value_type& operator[](const K& k);
+
   // MODIFIES: this
   // EFFECTS : Inserts the given element into this Map if the given key
   //           is not already contained in the Map. If the key is
@@ -108,68 +263,527 @@ public:
   //           the value true.
   std::pair<Iterator, bool> insert(const Pair_type &val);
 
+  // MODIFIES: this
+  // EFFECTS : Same as above, but moves val into the new element if one is
+  //           inserted.
+  std::pair<Iterator, bool> insert(Pair_type &&val);
+
+  // MODIFIES: this
+  // EFFECTS : Same as insert(val), but if the key of val is not in the
+  //           Map and belongs right before hint (or after every key, for
+  //           an end iterator), inserts val there after comparing it with
+  //           just those two neighbours instead of searching from the
+  //           root. Returns an iterator to the element with val's key.
+  // NOTE:     To insert pairs in increasing key order, pass end() as the
+  //           hint each time.
+  Iterator insert(Iterator hint, const Pair_type &val);
+
+  // MODIFIES: this
+  // EFFECTS : Same as above, but moves val into the new element if one is
+  //           inserted.
+  Iterator insert(Iterator hint, Pair_type &&val);
+
+  // MODIFIES: this
+  // EFFECTS : Constructs a key-value pair from args and inserts it as
+  //           insert(hint, val) does.
+  template <typename... Args>
+  Iterator emplace_hint(Iterator hint, Args&&... args);
+
+  // MODIFIES: this
+  // EFFECTS : If k is already in the Map, does nothing and returns an
+  //           iterator to the existing element along with false.
+  //           Otherwise, inserts an element whose key is k and whose
+  //           value is constructed in place from args, and returns an
+  //           iterator to it along with true. Neither k nor args are
+  //           touched when the key is already present.
+  template <typename... Args>
+  std::pair<Iterator, bool> try_emplace(const Key_type& k, Args&&... args);
+
+  // MODIFIES: this
+  // EFFECTS : Same as above, but moves k into the new element if one is
+  //           inserted.
+  template <typename... Args>
+  std::pair<Iterator, bool> try_emplace(Key_type&& k, Args&&... args);
+
+  // REQUIRES: pos points to an element of this Map
+  // MODIFIES: this
+  // EFFECTS : Removes the element at pos and returns an iterator to the
+  //           element after it.
+  Iterator erase(Iterator pos);
+
+  // MODIFIES: this
+  // EFFECTS : Removes the element with key k, if there is one, and
+  //           returns the number of elements removed (0 or 1).
+  size_t erase(const Key_type& k);
+
+  // REQUIRES: [first, last) is a valid range of this Map
+  // MODIFIES: this
+  // EFFECTS : Removes every element in [first, last) and returns last.
+  Iterator erase(Iterator first, Iterator last);
+
+  // MODIFIES: this
+  // EFFECTS : Removes every element.
+  void clear();
+
+  // MODIFIES: this
+  // EFFECTS : Replaces the contents of this Map with the key-value pairs
+  //           in [first, last). If the keys are in strictly increasing
+  //           order, builds a balanced tree in O(n). Otherwise the pairs
+  //           are inserted one at a time and the first of any duplicate
+  //           keys wins.
+  template <typename ForwardIt>
+  void assign(ForwardIt first, ForwardIt last) {
+    _tree.assign(first, last);
+  }
+
+  // REQUIRES: the keys in [first, last) are in strictly increasing order
+  // MODIFIES: this
+  // EFFECTS : Replaces the contents of this Map with the key-value pairs
+  //           in [first, last) in O(n).
+  template <typename ForwardIt>
+  void assign(SortedUnique, ForwardIt first, ForwardIt last) {
+    _tree.assign(sorted_unique, first, last);
+  }
+
+  // REQUIRES: Balance is AvlBalance, 'other' uses an equal allocator and
+  //           'combine' does not throw
+  // MODIFIES: this, other
+  // EFFECTS : Moves every key-value pair of 'other' into this Map, leaving
+  //           'other' empty. For a key in both, calls
+  //           combine(mine, std::move(theirs)) on the two values, e.g. to
+  //           add up counts. Takes O(m log(n/m + 1)) work for Maps of sizes
+  //           m <= n and may use several threads; see
+  //           BinarySearchTree::union_with.
+  template <typename Combiner>
+  void union_with(Map &&other, Combiner combine) {
+    _tree.union_with(std::move(other._tree),
+                     [&combine](Pair_type &mine, Pair_type &&theirs) {
+                       combine(mine.second, std::move(theirs.second));
+                     });
+  }
+
+  // REQUIRES: as for union_with
+  // MODIFIES: this, other
+  // EFFECTS : Moves the key-value pairs of 'other' whose keys are not in
+  //           this Map into it, and empties 'other'.
+  void merge(Map &&other) {
+    _tree.merge(std::move(other._tree));
+  }
+
+  // REQUIRES: as for union_with
+  // MODIFIES: this, other
+  // EFFECTS : Removes every key that is not in 'other', and empties
+  //           'other'. For the keys that remain, calls
+  //           combine(mine, std::move(theirs)) on the two values.
+  template <typename Combiner>
+  void intersection_with(Map &&other, Combiner combine) {
+    _tree.intersection_with(std::move(other._tree),
+                            [&combine](Pair_type &mine, Pair_type &&theirs) {
+                              combine(mine.second, std::move(theirs.second));
+                            });
+  }
+
+  // REQUIRES: as for union_with
+  // MODIFIES: this, other
+  // EFFECTS : Removes every key that is not in 'other', and empties
+  //           'other'.
+  void intersection_with(Map &&other) {
+    _tree.intersection_with(std::move(other._tree));
+  }
+
+  // REQUIRES: as for union_with
+  // MODIFIES: this, other
+  // EFFECTS : Removes every key that is in 'other', and empties 'other'.
+  void difference_with(Map &&other) {
+    _tree.difference_with(std::move(other._tree));
+  }
+
+  // REQUIRES: Key_type and Value_type are supported by Serialize.hpp,
+  //           which is included
+  // MODIFIES: os
+  // EFFECTS : Writes the key-value pairs to 'os' in key order, in the
+  //           format described in Serialize.hpp. The result can be read
+  //           back with deserialize() or opened with MappedMap.
+  void serialize(std::ostream &os) const {
+    _tree.serialize(os);
+  }
+
+  // REQUIRES: 'is' holds data written by serialize() on a Map with the
+  //           same types and Key_compare, and Serialize.hpp is included
+  // MODIFIES: this, is
+  // EFFECTS : Replaces the contents of this Map with the pairs read from
+  //           'is', in O(n). Throws serialize_exception, leaving this Map
+  //           unchanged, if the data cannot be read.
+  void deserialize(std::istream &is) {
+    _tree.deserialize(is);
+  }
+
+  // MODIFIES: os
+  // EFFECTS : Prints the shape of the tree behind this Map (size, height,
+  //           average search path length and depth histogram) and, when
+  //           compiled with -DBST_INSTRUMENTATION, the work counted in
+  //           stats(). See BinarySearchTree::print_stats.
+  void print_stats(std::ostream &os) const {
+    _tree.print_stats(os);
+  }
+
+#ifdef BST_INSTRUMENTATION
+  // EFFECTS : Returns the comparisons, node visits, allocations and
+  //           rotations counted for this Map (see TreeStats).
+  const TreeStats &stats() const {
+    return _tree.stats();
+  }
+
+  // MODIFIES: this
+  // EFFECTS : Sets every count in stats() back to zero.
+  void reset_stats() {
+    _tree.reset_stats();
+  }
+#endif
+
+  // Type alias for an immutable copy of a Map, made by freeze(). It has
+  // find, contains, count, lower_bound and begin/end like a Map.
+  using Frozen = FrozenTree<Pair_type, PairComp>;
+
+  // REQUIRES: FrozenTree.hpp is included
+  // EFFECTS : Returns an immutable copy of this Map laid out for faster
+  //           lookups, for when it will no longer change. Takes O(n).
+  Frozen freeze() const {
+    return _tree.freeze();
+  }
+
   // EFFECTS : Returns an iterator to the first key-value pair in this Map.
   Iterator begin() const;
 
   // EFFECTS : Returns an iterator to "past-the-end".
   Iterator end() const;
 
+  // Type alias for an iterator over the key-value pairs in descending
+  // key order
+  using Reverse_iterator = std::reverse_iterator<Iterator>;
+
+  // EFFECTS : Returns a reverse iterator to the last key-value pair in
+  //           this Map.
+  Reverse_iterator rbegin() const;
+
+  // EFFECTS : Returns a reverse iterator to "before-the-beginning".
+  Reverse_iterator rend() const;
+
 private:
-  BinarySearchTree<Pair_type, PairComp> _tree;
+  BinarySearchTree<Pair_type, PairComp, Balance, Allocator> _tree;
+
+  // MODIFIES: this
+  // EFFECTS : Returns an iterator to the first element whose key is not
+  //           less than key, which is where an element with that key
+  //           belongs, along with whether its key is equivalent to key.
+  //           Searches once, so inserting there afterwards (with
+  //           emplace_hint on the tree) needs no second search.
+  template <typename Query>
+  std::pair<Iterator, bool> locate(const Query& key) {
+    Iterator pos = _tree.lower_bound(key);
+    return std::pair{pos, pos != end() && !Key_compare{}(key, pos->first)};
+  }
+
+  // EFFECTS : Returns whether key is not in this Map and belongs right
+  //           before hint, comparing it only with hint and the element
+  //           before it.
+  bool fits_before(Iterator hint, const Key_type& key) const {
+    return (hint == end() || Key_compare{}(key, hint->first))
+      && (hint == begin() || Key_compare{}(std::prev(hint)->first, key));
+  }
 };
 
 // You may implement member functions below using an "out-of-line" definition
 // or you may simply define them "in-line" in the class definition above.
 // If you choose to define them "out-of-line", here is an example.
-// (Note that we're using K, V, and C as shorthands for Key_type,
-// Value_type, and Key_compare, respectively - the compiler doesn't
+// (Note that we're using K, V, C, B, and A as shorthands for Key_type,
+// Value_type, Key_compare, Balance, and Allocator, respectively - the compiler doesn't
 // mind, and will just match them up by position.)
-//    template <typename K, typename V, typename C>
-//    typename Map<K, V, C>::Iterator Map<K, V, C>::begin() const {
+//    template <typename K, typename V, typename C, typename B, typename A>
+//    typename Map<K, V, C, B, A>::Iterator Map<K, V, C, B, A>::begin() const {
 //      // YOUR IMPLEMENTATION GOES HERE
 //    }
 
-template <typename K, typename V, typename C>
-bool Map<K, V, C>::empty() const {
+template <typename K, typename V, typename C, typename B, typename A>
+bool Map<K, V, C, B, A>::empty() const {
   return _tree.empty();
 }
 
-template <typename K, typename V, typename C>
-size_t Map<K, V, C>::size() const {
+template <typename K, typename V, typename C, typename B, typename A>
+size_t Map<K, V, C, B, A>::size() const {
   return _tree.size();
 }
 
-template <typename K, typename V, typename C>
-typename Map<K, V, C>::Iterator Map<K, V, C>::find(const K& key) const {
-  return _tree.find(std::pair{key, V()});
+template <typename K, typename V, typename C, typename B, typename A>
+typename Map<K, V, C, B, A>::Iterator Map<K, V, C, B, A>::find(const K& key) const {
+  return _tree.find(key);
+}
+
+template <typename K, typename V, typename C, typename B, typename A>
+template <typename Query, typename, typename>
+typename Map<K, V, C, B, A>::Iterator Map<K, V, C, B, A>::find(
+  const Query& query
+) const {
+  return _tree.find(query);
+}
+
+template <typename K, typename V, typename C, typename B, typename A>
+typename Map<K, V, C, B, A>::Iterator Map<K, V, C, B, A>::find_from(
+  Iterator finger, const K& key
+) const {
+  return _tree.find_from(finger, key);
+}
+
+template <typename K, typename V, typename C, typename B, typename A>
+template <typename Query, typename, typename>
+typename Map<K, V, C, B, A>::Iterator Map<K, V, C, B, A>::find_from(
+  Iterator finger, const Query& query
+) const {
+  return _tree.find_from(finger, query);
+}
+
+template <typename K, typename V, typename C, typename B, typename A>
+bool Map<K, V, C, B, A>::contains(const K& key) const {
+  return _tree.contains(key);
+}
+
+template <typename K, typename V, typename C, typename B, typename A>
+template <typename Query, typename, typename>
+bool Map<K, V, C, B, A>::contains(const Query& query) const {
+  return _tree.contains(query);
+}
+
+template <typename K, typename V, typename C, typename B, typename A>
+size_t Map<K, V, C, B, A>::count(const K& key) const {
+  return _tree.count(key);
+}
+
+template <typename K, typename V, typename C, typename B, typename A>
+template <typename Query, typename, typename>
+size_t Map<K, V, C, B, A>::count(const Query& query) const {
+  return _tree.count(query);
+}
+
+template <typename K, typename V, typename C, typename B, typename A>
+size_t Map<K, V, C, B, A>::rank(const K& key) const {
+  return _tree.rank(key);
+}
+
+template <typename K, typename V, typename C, typename B, typename A>
+typename Map<K, V, C, B, A>::Iterator Map<K, V, C, B, A>::select(
+  size_t n
+) const {
+  return _tree.select(n);
+}
+
+template <typename K, typename V, typename C, typename B, typename A>
+size_t Map<K, V, C, B, A>::count_range(const K& lo, const K& hi) const {
+  return _tree.count_range(lo, hi);
+}
+
+template <typename K, typename V, typename C, typename B, typename A>
+typename Map<K, V, C, B, A>::Iterator Map<K, V, C, B, A>::lower_bound(
+  const K& key
+) const {
+  return _tree.lower_bound(key);
+}
+
+template <typename K, typename V, typename C, typename B, typename A>
+template <typename Query, typename, typename>
+typename Map<K, V, C, B, A>::Iterator Map<K, V, C, B, A>::lower_bound(
+  const Query& query
+) const {
+  return _tree.lower_bound(query);
+}
+
+template <typename K, typename V, typename C, typename B, typename A>
+typename Map<K, V, C, B, A>::Iterator Map<K, V, C, B, A>::upper_bound(
+  const K& key
+) const {
+  return _tree.upper_bound(key);
+}
+
+template <typename K, typename V, typename C, typename B, typename A>
+template <typename Query, typename, typename>
+typename Map<K, V, C, B, A>::Iterator Map<K, V, C, B, A>::upper_bound(
+  const Query& query
+) const {
+  return _tree.upper_bound(query);
+}
+
+template <typename K, typename V, typename C, typename B, typename A>
+std::pair<typename Map<K, V, C, B, A>::Iterator,
+          typename Map<K, V, C, B, A>::Iterator>
+Map<K, V, C, B, A>::equal_range(const K& key) const {
+  return _tree.equal_range(key);
+}
+
+template <typename K, typename V, typename C, typename B, typename A>
+template <typename Query, typename, typename>
+std::pair<typename Map<K, V, C, B, A>::Iterator,
+          typename Map<K, V, C, B, A>::Iterator>
+Map<K, V, C, B, A>::equal_range(const Query& query) const {
+  return _tree.equal_range(query);
+}
+
+template <typename K, typename V, typename C, typename B, typename A>
+typename Map<K, V, C, B, A>::Range Map<K, V, C, B, A>::range(
+  const K& lo, const K& hi
+) const {
+  return _tree.range(lo, hi);
+}
+
+template <typename K, typename V, typename C, typename B, typename A>
+template <typename Query, typename, typename>
+typename Map<K, V, C, B, A>::Range Map<K, V, C, B, A>::range(
+  const Query& lo, const Query& hi
+) const {
+  return _tree.range(lo, hi);
+}
+
+template <typename K, typename V, typename C, typename B, typename A>
+V& Map<K, V, C, B, A>::operator[](const K& key) {
+  return (*try_emplace(key).first).second;
+}
+
+template <typename K, typename V, typename C, typename B, typename A>
+V& Map<K, V, C, B, A>::operator[](K&& key) {
+  return (*try_emplace(std::move(key)).first).second;
 }
 
-template <typename K, typename V, typename C>
-V& Map<K, V, C>::operator[](const K& key) {
-  auto element = find(key);
-  if(element != end())
-    return (*element).second;
-  return (*(insert(std::pair{key, V()}).first)).second;
+template <typename K, typename V, typename C, typename B, typename A>
+template <typename Query, typename, typename>
+V& Map<K, V, C, B, A>::operator[](const Query& query) {
+  auto [it, found] = locate(query);
+  if(found)
+    return (*it).second;
+  return (*_tree.emplace_hint(it, std::piecewise_construct,
+                              std::forward_as_tuple(query),
+                              std::forward_as_tuple())).second;
 }
 
-template <typename K, typename V, typename C>
-std::pair<typename Map<K, V, C>::Iterator, bool> Map<K, V, C>::insert(
+template <typename K, typename V, typename C, typename B, typename A>
+std::pair<typename Map<K, V, C, B, A>::Iterator, bool> Map<K, V, C, B, A>::insert(
   const Pair_type& val
 ) {
-  auto it = find(val.first);
-  if(it == end())
-    return std::pair{_tree.insert(val), true};
+  auto [it, found] = locate(val.first);
+  if(!found)
+    return std::pair{_tree.insert(it, val), true};
+  return std::pair{it, false};
+}
+
+template <typename K, typename V, typename C, typename B, typename A>
+std::pair<typename Map<K, V, C, B, A>::Iterator, bool> Map<K, V, C, B, A>::insert(
+  Pair_type&& val
+) {
+  auto [it, found] = locate(val.first);
+  if(!found)
+    return std::pair{_tree.insert(it, std::move(val)), true};
   return std::pair{it, false};
 }
 
-template <typename K, typename V, typename C>
-typename Map<K, V, C>::Iterator Map<K, V, C>::begin() const {
+template <typename K, typename V, typename C, typename B, typename A>
+typename Map<K, V, C, B, A>::Iterator Map<K, V, C, B, A>::insert(
+  Iterator hint, const Pair_type& val
+) {
+  if(fits_before(hint, val.first))
+    return _tree.insert(hint, val);
+  return insert(val).first;
+}
+
+template <typename K, typename V, typename C, typename B, typename A>
+typename Map<K, V, C, B, A>::Iterator Map<K, V, C, B, A>::insert(
+  Iterator hint, Pair_type&& val
+) {
+  if(fits_before(hint, val.first))
+    return _tree.insert(hint, std::move(val));
+  return insert(std::move(val)).first;
+}
+
+template <typename K, typename V, typename C, typename B, typename A>
+template <typename... Args>
+typename Map<K, V, C, B, A>::Iterator Map<K, V, C, B, A>::emplace_hint(
+  Iterator hint, Args&&... args
+) {
+  return insert(hint, Pair_type(std::forward<Args>(args)...));
+}
+
+template <typename K, typename V, typename C, typename B, typename A>
+template <typename... Args>
+std::pair<typename Map<K, V, C, B, A>::Iterator, bool>
+Map<K, V, C, B, A>::try_emplace(const K& key, Args&&... args) {
+  auto [it, found] = locate(key);
+  if(found)
+    return std::pair{it, false};
+  return std::pair{_tree.emplace_hint(it, std::piecewise_construct,
+                                      std::forward_as_tuple(key),
+                                      std::forward_as_tuple(
+                                        std::forward<Args>(args)...)),
+                   true};
+}
+
+template <typename K, typename V, typename C, typename B, typename A>
+template <typename... Args>
+std::pair<typename Map<K, V, C, B, A>::Iterator, bool>
+Map<K, V, C, B, A>::try_emplace(K&& key, Args&&... args) {
+  auto [it, found] = locate(key);
+  if(found)
+    return std::pair{it, false};
+  return std::pair{_tree.emplace_hint(it, std::piecewise_construct,
+                                      std::forward_as_tuple(std::move(key)),
+                                      std::forward_as_tuple(
+                                        std::forward<Args>(args)...)),
+                   true};
+}
+
+template <typename K, typename V, typename C, typename B, typename A>
+typename Map<K, V, C, B, A>::Iterator Map<K, V, C, B, A>::erase(
+  Iterator pos
+) {
+  return _tree.erase(pos);
+}
+
+template <typename K, typename V, typename C, typename B, typename A>
+size_t Map<K, V, C, B, A>::erase(const K& key) {
+  auto it = find(key);
+  if(it == end())
+    return 0;
+  _tree.erase(it);
+  return 1;
+}
+
+template <typename K, typename V, typename C, typename B, typename A>
+typename Map<K, V, C, B, A>::Iterator Map<K, V, C, B, A>::erase(
+  Iterator first, Iterator last
+) {
+  return _tree.erase(first, last);
+}
+
+template <typename K, typename V, typename C, typename B, typename A>
+void Map<K, V, C, B, A>::clear() {
+  _tree.clear();
+}
+
+template <typename K, typename V, typename C, typename B, typename A>
+typename Map<K, V, C, B, A>::Iterator Map<K, V, C, B, A>::begin() const {
   return _tree.begin();
 }
 
-template <typename K, typename V, typename C>
-typename Map<K, V, C>::Iterator Map<K, V, C>::end() const {
+template <typename K, typename V, typename C, typename B, typename A>
+typename Map<K, V, C, B, A>::Iterator Map<K, V, C, B, A>::end() const {
   return _tree.end();
 }
 
+template <typename K, typename V, typename C, typename B, typename A>
+typename Map<K, V, C, B, A>::Reverse_iterator
+Map<K, V, C, B, A>::rbegin() const {
+  return _tree.rbegin();
+}
+
+template <typename K, typename V, typename C, typename B, typename A>
+typename Map<K, V, C, B, A>::Reverse_iterator
+Map<K, V, C, B, A>::rend() const {
+  return _tree.rend();
+}
+
 #endif // DO NOT REMOVE!!!
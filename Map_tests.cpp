@@ -1,5 +1,15 @@
 #include "Map.hpp"
+#include "Arena.hpp"
+#include "NodePool.hpp"
+#include "Serialize.hpp"
 #include "unit_test_framework.hpp"
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <random>
+#include <vector>
+#include <string_view>
 
 TEST(map_ctor) {
     Map<std::string, int> map;
@@ -91,4 +101,444 @@ TEST(index_edit) {
     ASSERT_EQUAL((*map.begin()).second, "456");
 }
 
+TEST(balanced_map) {
+    Map<int, int, std::less<int>, AvlBalance> map;
+    for(int i = 0; i < 1000; ++i)
+        map[i] = i * 2;
+
+    ASSERT_EQUAL(map.size(), 1000);
+    ASSERT_EQUAL((*map.find(500)).second, 1000);
+    ASSERT_EQUAL((*map.begin()).first, 0);
+}
+
+TEST(arena_map) {
+    Arena arena;
+    using Alloc = ArenaAllocator<std::pair<std::string, int>>;
+    Map<std::string, int, std::less<std::string>, AvlBalance, Alloc>
+        map{Alloc(arena)};
+    map["hello"] += 1;
+    map["world"] += 2;
+    map["hello"] += 3;
+
+    ASSERT_EQUAL(map.size(), 2);
+    ASSERT_EQUAL(map["hello"], 4);
+    ASSERT_EQUAL(arena.allocation_count(), 2);
+}
+
+TEST(node_pool_map) {
+    NodePool pool(2);
+    using Alloc = NodePoolAllocator<std::pair<std::string, int>>;
+    Map<std::string, int, std::less<std::string>, AvlBalance, Alloc>
+        map{Alloc(pool)};
+    map["hello"] += 1;
+    map["world"] += 2;
+    map["hello"] += 3;
+
+    bool threw = false;
+    try {
+        map["again"] = 5;
+    }
+    catch (const std::length_error &) {
+        threw = true;
+    }
+    ASSERT_TRUE(threw);
+    ASSERT_EQUAL(map.size(), 2);
+    ASSERT_EQUAL(map["hello"], 4);
+    ASSERT_FALSE(map.contains("again"));
+    ASSERT_EQUAL(pool.in_use(), 2);
+}
+
+TEST(rank_select) {
+    Map<std::string, int> map;
+    map["banana"] = 2;
+    map["apple"] = 1;
+    map["cherry"] = 3;
+    map["date"] = 4;
+
+    ASSERT_EQUAL(map.rank("apple"), 0);
+    ASSERT_EQUAL(map.rank("c"), 2);
+    ASSERT_EQUAL((*map.select(2)).first, "cherry");
+    ASSERT_EQUAL(map.select(4), map.end());
+    ASSERT_EQUAL(map.count_range("b", "d"), 2);
+}
+
+TEST(try_emplace_single_allocation) {
+    Arena arena;
+    using Alloc = ArenaAllocator<std::pair<std::string, int>>;
+    Map<std::string, int, std::less<std::string>, NoBalance, Alloc>
+        map{Alloc(arena)};
+
+    // Long enough that std::string keeps it on the heap
+    std::string word(40, 'w');
+    const char *buffer = word.data();
+
+    auto res = map.try_emplace(std::move(word), 1);
+    ASSERT_TRUE(res.second);
+    ASSERT_EQUAL(arena.allocation_count(), 1);
+    ASSERT_TRUE((*res.first).first.data() == buffer);
+
+    std::string again(40, 'w');
+    res = map.try_emplace(std::move(again), 5);
+    ASSERT_FALSE(res.second);
+    ASSERT_EQUAL((*res.first).second, 1);
+    ASSERT_EQUAL(again.size(), 40);
+    ASSERT_EQUAL(arena.allocation_count(), 1);
+
+    std::string other(40, 'x');
+    buffer = other.data();
+    map[std::move(other)] = 7;
+    ASSERT_EQUAL(arena.allocation_count(), 2);
+    ASSERT_TRUE((*map.find(std::string(40, 'x'))).first.data() == buffer);
+}
+
+TEST(insert_rvalue) {
+    Map<std::string, std::string> map;
+    std::pair<std::string, std::string> entry{"key", std::string(40, 'v')};
+    const char *buffer = entry.second.data();
+
+    auto res = map.insert(std::move(entry));
+    ASSERT_TRUE(res.second);
+    ASSERT_TRUE((*res.first).second.data() == buffer);
+}
+
+TEST(move_map) {
+    Map<std::string, int> map;
+    map["a"] = 1;
+    map["b"] = 2;
+
+    Map<std::string, int> map_2(std::move(map));
+    ASSERT_EQUAL(map_2.size(), 2);
+    ASSERT_TRUE(map.empty());
+
+    map = std::move(map_2);
+    ASSERT_EQUAL(map["b"], 2);
+}
+
+TEST(erase) {
+    Map<std::string, int> map;
+    map["apple"] = 1;
+    map["banana"] = 2;
+    map["cherry"] = 3;
+    map["date"] = 4;
+
+    ASSERT_EQUAL(map.erase("banana"), 1);
+    ASSERT_EQUAL(map.erase("banana"), 0);
+    ASSERT_EQUAL(map.find("banana"), map.end());
+    ASSERT_EQUAL(map.size(), 3);
+
+    auto next = map.erase(map.find("apple"));
+    ASSERT_EQUAL((*next).first, "cherry");
+
+    map.erase(map.begin(), map.find("date"));
+    ASSERT_EQUAL(map.size(), 1);
+    ASSERT_EQUAL((*map.begin()).first, "date");
+
+    map.clear();
+    ASSERT_TRUE(map.empty());
+}
+
+TEST(build_sorted) {
+    std::vector<std::pair<std::string, int>> entries;
+    for(char c = 'a'; c <= 'z'; ++c)
+        entries.push_back({std::string(1, c), c - 'a'});
+
+    Map<std::string, int> map(entries.begin(), entries.end());
+    ASSERT_EQUAL(map.size(), 26);
+    ASSERT_EQUAL(map["q"], 16);
+
+    std::vector<std::pair<std::string, int>> unsorted =
+        {{"b", 1}, {"a", 2}, {"b", 3}};
+    map.assign(unsorted.begin(), unsorted.end());
+    ASSERT_EQUAL(map.size(), 2);
+    ASSERT_EQUAL(map["b"], 1);
+
+    Map<std::string, int> map_2(sorted_unique, entries.begin(), entries.end());
+    ASSERT_EQUAL((*map_2.select(25)).first, "z");
+}
+
+// A key type that counts how many times one is constructed
+struct CountedKey {
+    static int constructed;
+
+    explicit CountedKey(std::string_view name_in) : name(name_in) {
+        ++constructed;
+    }
+    CountedKey(const CountedKey &other) : name(other.name) {
+        ++constructed;
+    }
+
+    std::string name;
+};
+int CountedKey::constructed = 0;
+
+struct CountedKeyLess {
+    using is_transparent = void;
+
+    static std::string_view view(const CountedKey &key) {
+        return key.name;
+    }
+    static std::string_view view(std::string_view name) {
+        return name;
+    }
+
+    template <typename A, typename B>
+    bool operator()(const A &a, const B &b) const {
+        return view(a) < view(b);
+    }
+};
+
+TEST(transparent_lookup) {
+    Map<CountedKey, int, CountedKeyLess> map;
+    map.insert({CountedKey("apple"), 1});
+    map.insert({CountedKey("banana"), 2});
+
+    int before = CountedKey::constructed;
+    std::string_view banana = "banana";
+    ASSERT_EQUAL((*map.find(banana)).second, 2);
+    ASSERT_TRUE(map.contains(std::string_view("apple")));
+    ASSERT_EQUAL(map.count(std::string_view("cherry")), 0);
+    ASSERT_EQUAL(map[banana], 2);
+    ASSERT_EQUAL(CountedKey::constructed, before);
+
+    // Only inserting a new element builds a key
+    map[std::string_view("cherry")] = 3;
+    ASSERT_EQUAL(CountedKey::constructed, before + 1);
+    ASSERT_EQUAL(map.size(), 3);
+}
+
+TEST(transparent_string_keys) {
+    Map<std::string, int, std::less<>> map;
+    map["hello"] = 1;
+    std::string_view world = "world";
+    map[world] = 2;
+
+    ASSERT_EQUAL((*map.find("hello")).second, 1);
+    ASSERT_EQUAL((*map.find(world)).first, "world");
+    ASSERT_TRUE(map.contains("world"));
+    ASSERT_FALSE(map.contains(std::string_view("nope")));
+    ASSERT_EQUAL(map.count("hello"), 1);
+    ASSERT_EQUAL(map.count_range("a", "i"), 1);
+}
+
+TEST(find_does_not_build_value) {
+    // Lookups with the ordinary key type don't need Value_type() either
+    Map<std::string, std::vector<int>> map;
+    map["a"].push_back(1);
+    ASSERT_EQUAL(map.count("a"), 1);
+    ASSERT_EQUAL(map.erase("b"), 0);
+    ASSERT_EQUAL(map.erase("a"), 1);
+}
+
+TEST(union_with_sums_counts) {
+    using Counts = Map<std::string, int, std::less<std::string>, AvlBalance>;
+    Counts total, part;
+    total["a"] = 1;
+    total["b"] = 2;
+    part["b"] = 10;
+    part["c"] = 5;
+
+    total.union_with(std::move(part), [](int &mine, int &&theirs) {
+        mine += theirs;
+    });
+    ASSERT_TRUE(part.empty());
+    ASSERT_EQUAL(total.size(), 3);
+    ASSERT_EQUAL(total["a"], 1);
+    ASSERT_EQUAL(total["b"], 12);
+    ASSERT_EQUAL(total["c"], 5);
+
+    Counts other;
+    other["b"] = 100;
+    other["z"] = 1;
+    Counts both(total);
+    both.intersection_with(Counts(other), [](int &mine, int &&theirs) {
+        mine -= theirs;
+    });
+    ASSERT_EQUAL(both.size(), 1);
+    ASSERT_EQUAL(both["b"], -88);
+
+    total.merge(Counts(other));
+    ASSERT_EQUAL(total["b"], 12);
+    ASSERT_EQUAL(total["z"], 1);
+    total.difference_with(std::move(other));
+    ASSERT_EQUAL(total.size(), 2);
+    ASSERT_FALSE(total.contains("b"));
+}
+
+TEST(bounds_match_std_map) {
+    Map<int, int, std::less<int>, AvlBalance> map;
+    std::map<int, int> expected;
+    std::mt19937 gen(280);
+    for(int i = 0; i < 2000; ++i) {
+        int k = gen() % 4000;
+        map[k] = i;
+        expected[k] = i;
+    }
+
+    for(int i = 0; i < 500; ++i) {
+        int q = gen() % 4100 - 50;
+        auto lower = map.lower_bound(q);
+        auto expected_lower = expected.lower_bound(q);
+        ASSERT_EQUAL(lower == map.end(), expected_lower == expected.end());
+        if(lower != map.end())
+            ASSERT_EQUAL(lower->second, expected_lower->second);
+
+        auto upper = map.upper_bound(q);
+        auto expected_upper = expected.upper_bound(q);
+        ASSERT_EQUAL(upper == map.end(), expected_upper == expected.end());
+        if(upper != map.end())
+            ASSERT_EQUAL(upper->first, expected_upper->first);
+
+        auto range = map.equal_range(q);
+        ASSERT_EQUAL(range.first == range.second, !expected.count(q));
+
+        int hi = gen() % 4100 - 50;
+        auto expected_it = expected.lower_bound(q);
+        for(const auto &kv : map.range(q, hi)) {
+            ASSERT_EQUAL(kv.first, expected_it->first);
+            ASSERT_EQUAL(kv.second, expected_it->second);
+            ++expected_it;
+        }
+        ASSERT_TRUE(expected_it == expected.end() || hi <= expected_it->first);
+    }
+}
+
+TEST(range_transparent_prefix) {
+    Map<std::string, int, std::less<>> map;
+    map["valgrind"] = 1;
+    map["valid"] = 2;
+    map["valgrinding"] = 3;
+    std::string_view lo = "valgr";
+    std::string_view hi = "valgs";
+    int sum = 0;
+    for(const auto &kv : map.range(lo, hi))
+        sum += kv.second;
+    ASSERT_EQUAL(sum, 4);
+    ASSERT_EQUAL(map.lower_bound(lo)->first, "valgrind");
+    ASSERT_EQUAL(map.upper_bound(std::string_view("valgrind"))->first,
+                 "valgrinding");
+}
+
+TEST(reverse_iteration) {
+    Map<std::string, int> map;
+    map["b"] = 2;
+    map["a"] = 1;
+    map["c"] = 3;
+
+    std::string keys;
+    for(auto it = map.rbegin(); it != map.rend(); ++it)
+        keys += it->first;
+    ASSERT_EQUAL(keys, "cba");
+
+    auto last = map.end();
+    --last;
+    ASSERT_EQUAL(last->second, 3);
+    ASSERT_EQUAL(std::prev(last)->first, "b");
+
+    auto largest = std::max_element(map.begin(), map.end(),
+        [](const auto &a, const auto &b) { return a.second < b.second; });
+    ASSERT_EQUAL(largest->first, "c");
+}
+
+TEST(serialize_map) {
+    Map<std::string, double> map;
+    map["pi"] = 3.14159;
+    map["e"] = 2.71828;
+    map["zero"] = 0;
+
+    std::stringstream buffer;
+    map.serialize(buffer);
+    Map<std::string, double> copy;
+    copy.deserialize(buffer);
+    ASSERT_EQUAL(copy.size(), 3);
+    ASSERT_EQUAL(copy["pi"], 3.14159);
+    ASSERT_EQUAL(copy.begin()->first, "e");
+}
+
+TEST(hinted_insert) {
+    Map<int, std::string> map;
+    for (int i = 0; i < 100; ++i) {
+        auto it = map.emplace_hint(map.end(), i, std::to_string(i));
+        ASSERT_EQUAL(it->first, i);
+    }
+    ASSERT_EQUAL(map.size(), 100);
+
+    // An existing key is left alone, whatever the hint
+    auto it = map.insert(map.begin(), {50, "fifty"});
+    ASSERT_EQUAL(it->second, "50");
+    it = map.insert(map.find(51), {50, "fifty"});
+    ASSERT_EQUAL(it->second, "50");
+
+    // A wrong hint still inserts in the right place
+    map.erase(map.find(20));
+    it = map.insert(map.end(), {20, "twenty"});
+    ASSERT_EQUAL(std::next(it)->first, 21);
+    ASSERT_EQUAL(map.size(), 100);
+
+    auto finger = map.find(30);
+    ASSERT_EQUAL(map.find_from(finger, 31)->second, "31");
+    ASSERT_EQUAL(map.find_from(finger, 20)->second, "twenty");
+    ASSERT_EQUAL(map.find_from(finger, 100), map.end());
+}
+
+// Orders ints as usual, counting every comparison made
+struct CountingLess {
+    static int calls;
+
+    bool operator()(int a, int b) const {
+        ++calls;
+        return a < b;
+    }
+};
+int CountingLess::calls = 0;
+
+TEST(splay_index_moves_key_to_root) {
+    Map<int, int, CountingLess, SplayBalance> map;
+    std::mt19937 gen(280);
+    for (int i = 0; i < 1000; ++i) {
+        map[int(gen() % 100000)] += 1;
+    }
+    int key = map.begin()->first;
+
+    // The first lookup splays the key to the root, so later ones find it
+    // there in a fixed number of comparisons however big the map is
+    map[key] += 1;
+    for (int i = 0; i < 3; ++i) {
+        CountingLess::calls = 0;
+        map[key] += 1;
+        ASSERT_TRUE(CountingLess::calls <= 3);
+    }
+    CountingLess::calls = 0;
+    ASSERT_TRUE(map.try_emplace(key, 0).first->second >= 5);
+    ASSERT_TRUE(CountingLess::calls <= 3);
+
+    // A new key is splayed to the root as it is inserted
+    int fresh = -1;
+    map[fresh] = 7;
+    CountingLess::calls = 0;
+    ASSERT_EQUAL(map[fresh], 7);
+    ASSERT_TRUE(CountingLess::calls <= 3);
+}
+
+TEST(copies_are_independent) {
+    Map<std::string, int> counts;
+    counts["apple"] = 1;
+    counts["pear"] = 2;
+
+    Map<std::string, int> snapshot = counts;
+    counts["apple"] = 10;
+    counts["fig"] = 3;
+    ASSERT_EQUAL(snapshot["apple"], 1);
+    ASSERT_FALSE(snapshot.contains("fig"));
+
+    Map<std::string, int> copy = counts;
+    for (auto &kv : copy) {
+        kv.second = 0;
+    }
+    copy.find("pear")->second = 7;
+    ASSERT_EQUAL(counts["apple"], 10);
+    ASSERT_EQUAL(counts["pear"], 2);
+    ASSERT_EQUAL(copy["pear"], 7);
+    ASSERT_EQUAL(copy.size(), 3);
+}
+
 TEST_MAIN()
@@ -0,0 +1,243 @@
+#ifndef MAPPED_MAP_HPP
+#define MAPPED_MAP_HPP
+/* MappedMap.hpp
+ *
+ * A read-only map over a file written by Map::serialize(). The file is
+ * mapped into memory with mmap and lookups binary search the records in
+ * place, so opening it costs the same no matter how large it is, and no
+ * nodes or strings are allocated. Pages are read from disk as lookups
+ * touch them.
+ *
+ * Example:
+ *   std::ofstream out("counts.bin", std::ios::binary);
+ *   counts.serialize(out);   // a Map<std::string, int>
+ *   ...
+ *   MappedMap<std::string, int> saved("counts.bin");
+ *   auto it = saved.find("valgrind");
+ *   if (it != saved.end()) { int n = it->second; }
+ */
+
+#include "Serialize.hpp"
+#include <cstddef>    //size_t, ptrdiff_t
+#include <functional> //less
+#include <iterator>   //input_iterator_tag
+#include <string>     //string
+#include <utility>    //pair
+#include <fcntl.h>    //open
+#include <sys/mman.h> //mmap, munmap
+#include <sys/stat.h> //fstat
+#include <unistd.h>   //close
+
+template <typename Key_type, typename Value_type,
+          typename Key_compare=std::less<> // must accept Key_view
+         >
+class MappedMap {
+
+  // OVERVIEW: An immutable, ordered map backed by a memory-mapped image.
+  //           Keys and values are read back as views: std::string fields
+  //           come back as std::string_view into the mapping, and numbers
+  //           by value. Views stay valid while the MappedMap exists.
+  //
+  // NOTE: Key_compare must order keys the way the Map that wrote the file
+  //       did, and must be able to compare a Key_view with the query
+  //       type; the default std::less<> does both for the usual keys.
+
+  using Pair_type = std::pair<Key_type, Value_type>;
+
+public:
+  using Key_view = typename SerialField<Key_type>::View;
+  using Value_view = typename SerialField<Value_type>::View;
+
+  class Iterator {
+    // OVERVIEW: Visits the key-value pairs in key order. Dereferencing
+    //           decodes the record into a pair of views, returned by value
+    //           (and reached through an Arrow proxy by ->), so it is only
+    //           an input iterator.
+
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = std::pair<Key_view, Value_view>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type *;
+    using reference = value_type;
+
+    Iterator()
+      : map(nullptr), index(0) { }
+
+    value_type operator*() const {
+      return value_type(map->key_at(index), map->value_at(index));
+    }
+
+    // Lets it->first and it->second work on the decoded pair
+    class Arrow {
+    public:
+      const value_type *operator->() const {
+        return &entry;
+      }
+
+    private:
+      friend class Iterator;
+      value_type entry;
+      explicit Arrow(value_type entry_in)
+        : entry(entry_in) { }
+    };
+
+    Arrow operator->() const {
+      return Arrow(**this);
+    }
+
+    Iterator &operator++() {
+      ++index;
+      return *this;
+    }
+
+    Iterator operator++(int) {
+      Iterator result(*this);
+      ++index;
+      return result;
+    }
+
+    bool operator==(const Iterator &rhs) const {
+      return index == rhs.index;
+    }
+
+    bool operator!=(const Iterator &rhs) const {
+      return index != rhs.index;
+    }
+
+  private:
+    friend class MappedMap;
+
+    const MappedMap *map;
+    size_t index;
+
+    Iterator(const MappedMap *map_in, size_t index_in)
+      : map(map_in), index(index_in) { }
+  };
+
+  // EFFECTS: Maps the file 'filename' read-only and checks that it holds
+  //          a serialized Map with these key and value types. Throws
+  //          serialize_exception if it cannot be opened, mapped or read.
+  explicit MappedMap(const std::string &filename)
+    : data(nullptr), length(0), view(map_file(filename)) { }
+
+  // A MappedMap owns its mapping, so it cannot be copied
+  MappedMap(const MappedMap &other) = delete;
+  MappedMap &operator=(const MappedMap &rhs) = delete;
+
+  // Destructor
+  ~MappedMap() {
+    munmap(data, length);
+  }
+
+  // EFFECTS: Returns whether this MappedMap is empty.
+  bool empty() const {
+    return size() == 0;
+  }
+
+  // EFFECTS: Returns the number of key-value pairs.
+  size_t size() const {
+    return view.size();
+  }
+
+  // EFFECTS: Returns an Iterator to the first key-value pair whose key is
+  //          not less than k, or an end Iterator. Runs in O(log n) and
+  //          touches only the records on the search path.
+  template <typename K>
+  Iterator lower_bound(const K &k) const {
+    size_t lo = 0;
+    size_t hi = size();
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (less(key_at(mid), k)) {
+        lo = mid + 1;
+      }
+      else {
+        hi = mid;
+      }
+    }
+    return Iterator(this, lo);
+  }
+
+  // EFFECTS: Returns an Iterator to the key-value pair with key k, or an
+  //          end Iterator if there is none.
+  template <typename K>
+  Iterator find(const K &k) const {
+    Iterator it = lower_bound(k);
+    if (it != end() && !less(k, key_at(it.index))) {
+      return it;
+    }
+    return end();
+  }
+
+  // EFFECTS: Returns whether there is a key-value pair with key k.
+  template <typename K>
+  bool contains(const K &k) const {
+    return find(k) != end();
+  }
+
+  // EFFECTS: Returns the number of key-value pairs with key k (0 or 1).
+  template <typename K>
+  size_t count(const K &k) const {
+    return contains(k) ? 1 : 0;
+  }
+
+  // EFFECTS: Returns an Iterator to the first key-value pair.
+  Iterator begin() const {
+    return Iterator(this, 0);
+  }
+
+  // EFFECTS: Returns an Iterator to "past-the-end".
+  Iterator end() const {
+    return Iterator(this, size());
+  }
+
+private:
+  void *data;
+  size_t length;
+  SerialView<Pair_type> view;
+  Key_compare less;
+
+  Key_view key_at(size_t index) const {
+    return SerialField<Key_type>::view(serial_get(view.record(index), 8),
+                                       view.string_pool(),
+                                       view.string_pool_size());
+  }
+
+  Value_view value_at(size_t index) const {
+    return SerialField<Value_type>::view(
+      serial_get(view.record(index) + 8, 8), view.string_pool(),
+      view.string_pool_size());
+  }
+
+  // MODIFIES: data, length
+  // EFFECTS : Maps 'filename' and returns a view of its image. Unmaps it
+  //           again if the image is not valid.
+  SerialView<Pair_type> map_file(const std::string &filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw serialize_exception("Error opening file: " + filename);
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+      close(fd);
+      throw serialize_exception("Not a serialized tree: " + filename);
+    }
+    length = static_cast<size_t>(info.st_size);
+    data = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+      data = nullptr;
+      throw serialize_exception("Error mapping file: " + filename);
+    }
+    try {
+      return SerialView<Pair_type>(static_cast<const char *>(data), length);
+    }
+    catch (...) {
+      munmap(data, length);
+      throw;
+    }
+  }
+};
+
+#endif // MAPPED_MAP_HPP
@@ -0,0 +1,137 @@
+#include "MappedMap.hpp"
+#include "Map.hpp"
+#include "unit_test_framework.hpp"
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+static const char *const test_file = "MappedMap_tests.tmp";
+
+// Both iterators hand out decoded copies, so they claim no more than
+// input iterators may
+static_assert(std::is_same_v<
+    std::iterator_traits<MappedMap<std::string, int>::Iterator>
+        ::iterator_category,
+    std::input_iterator_tag>);
+static_assert(std::is_same_v<
+    std::iterator_traits<SerialView<std::pair<std::string, int>>::Iterator>
+        ::iterator_category,
+    std::input_iterator_tag>);
+
+// Writes 'map' to the test file
+template <typename M>
+static void save(const M &map) {
+    std::ofstream out(test_file, std::ios::binary);
+    map.serialize(out);
+}
+
+TEST(mapped_find) {
+    Map<std::string, int> counts;
+    counts["valgrind"] = 4;
+    counts["gdb"] = 2;
+    counts["make"] = 7;
+    save(counts);
+
+    {
+        MappedMap<std::string, int> saved(test_file);
+        ASSERT_EQUAL(saved.size(), 3);
+        ASSERT_TRUE(saved.contains("gdb"));
+        ASSERT_EQUAL(saved.find(std::string("valgrind"))->second, 4);
+        ASSERT_EQUAL(saved.find(std::string_view("make"))->second, 7);
+        ASSERT_TRUE(saved.find("cmake") == saved.end());
+        ASSERT_EQUAL(saved.count("zzz"), 0);
+        ASSERT_EQUAL(saved.lower_bound("h")->first, "make");
+
+        std::string keys;
+        for (const auto &kv : saved) {
+            keys += std::string(kv.first) + " ";
+        }
+        ASSERT_EQUAL(keys, "gdb make valgrind ");
+    }
+    std::remove(test_file);
+}
+
+TEST(mapped_matches_map) {
+    Map<int, double> map;
+    std::mt19937 gen(280);
+    for (int i = 0; i < 5000; ++i) {
+        map[int(gen() % 20000) - 10000] = i * 0.5;
+    }
+    save(map);
+
+    {
+        MappedMap<int, double> saved(test_file);
+        ASSERT_EQUAL(saved.size(), map.size());
+        for (int k = -10001; k <= 10001; ++k) {
+            auto it = map.find(k);
+            auto saved_it = saved.find(k);
+            ASSERT_EQUAL(it == map.end(), saved_it == saved.end());
+            if (it != map.end()) {
+                ASSERT_EQUAL(saved_it->second, it->second);
+            }
+        }
+    }
+    std::remove(test_file);
+}
+
+TEST(mapped_rejects_bad_files) {
+    Map<int, int> numbers;
+    numbers[1] = 1;
+    save(numbers);
+
+    bool threw = false;
+    try {
+        MappedMap<std::string, int> wrong_type(test_file);
+    }
+    catch (const serialize_exception &) {
+        threw = true;
+    }
+    ASSERT_TRUE(threw);
+    std::remove(test_file);
+
+    threw = false;
+    try {
+        MappedMap<int, int> missing(test_file);
+    }
+    catch (const serialize_exception &) {
+        threw = true;
+    }
+    ASSERT_TRUE(threw);
+}
+
+TEST(mapped_checks_strings) {
+    Map<std::string, int> counts;
+    counts["gdb"] = 2;
+    counts["make"] = 7;
+    std::stringstream bytes;
+    counts.serialize(bytes);
+
+    // Point the last key past the end of the string pool
+    std::string image = bytes.str();
+    serial_put(&image[image.size() - 16], 1000, 4);
+    {
+        std::ofstream out(test_file, std::ios::binary);
+        out << image;
+    }
+
+    {
+        MappedMap<std::string, int> saved(test_file);
+        ASSERT_EQUAL(saved.begin()->first, "gdb");
+        bool threw = false;
+        try {
+            saved.find("make");
+        }
+        catch (const serialize_exception &) {
+            threw = true;
+        }
+        ASSERT_TRUE(threw);
+    }
+    std::remove(test_file);
+}
+
+TEST_MAIN()
@@ -0,0 +1,338 @@
+#ifndef NODE_POOL_HPP
+#define NODE_POOL_HPP
+/* NodePool.hpp
+ *
+ * A pool of fixed-size slots named by 32-bit indices, and a matching
+ * std::allocator-compatible allocator. A BinarySearchTree or Map whose
+ * nodes come from a NodePoolAllocator links them by index instead of by
+ * pointer and packs each node's cached height and size into 32 bits
+ * apiece, which saves 20 bytes per node, and can hold at most
+ * capacity() elements.
+ *
+ * Example:
+ *   NodePool pool;
+ *   Map<std::string, int, std::less<std::string>, NoBalance,
+ *       NodePoolAllocator<std::pair<std::string, int>>> words(pool);
+ */
+
+#include <cassert> //assert
+#include <cstddef> //size_t, max_align_t
+#include <cstdint> //uint32_t, uintptr_t
+#include <cstring> //memcpy
+#include <new>     //operator new, bad_alloc
+#include <type_traits> //true_type
+#include <vector>  //vector
+
+class NodePool {
+  // OVERVIEW: Hands out slots of one size, each named by a 32-bit index.
+  //           Slots live in chunks, and chunks never move once allocated.
+  //           Each chunk fills one chunk_align-byte window, aligned to
+  //           chunk_align, and starts with a header naming its pool and
+  //           its number. So the index of a slot, or the slot named by an
+  //           index, can be found from the address of any slot of the
+  //           pool alone (see index_of and address_near). Slot j of chunk
+  //           c is named by c << chunk_shift | j, which leaves some index
+  //           values unused when a chunk's slots are not a power of two.
+  //           Windows are carved out of blocks that grow with the pool,
+  //           up to max_block_chunks windows each. Freed slots are kept on a
+  //           list linked by index, written into the slots themselves, and
+  //           handed out again first.
+  //
+  //           The size of a slot is fixed by the first allocation; every
+  //           later one must fit in it. A pool is meant to hold the nodes
+  //           of one kind of tree, which all have the same size.
+
+public:
+  // The most slots a pool can hold: every index fits in 32 bits, with
+  // one value left over to end the free list.
+  static const size_t max_capacity = UINT32_MAX;
+
+  // Every chunk starts at a multiple of this many bytes and fits below
+  // the next one, so a slot's chunk is found by rounding its address
+  // down. A slot can be no larger than a chunk less its header.
+  static const size_t chunk_align = 4096;
+
+  // The most chunks carved out of one block of memory
+  static const size_t max_block_chunks = 16;
+
+  explicit NodePool(size_t capacity_in = max_capacity)
+    : blocks(), chunks(), next_window(nullptr), windows_left(0),
+      slot_size(0), slot_align(0), chunk_slots(0), chunk_shift(0),
+      pool_capacity(capacity_in < max_capacity ? capacity_in : max_capacity),
+      num_slots(0), num_in_use(0), free_head(no_slot) { }
+
+  // A NodePool owns its chunks, and they point back at it, so it can be
+  // neither copied nor moved
+  NodePool(const NodePool &other) = delete;
+  NodePool &operator=(const NodePool &rhs) = delete;
+
+  // Destructor
+  ~NodePool() {
+    for (char *block : blocks) {
+      ::operator delete(block);
+    }
+  }
+
+  // EFFECTS: Returns a slot of at least 'bytes' bytes aligned to 'align'.
+  //          Throws std::bad_alloc if capacity_for(bytes, align) slots
+  //          are in use, or if the request does not fit the pool's slot
+  //          size.
+  void *allocate(size_t bytes, size_t align) {
+    if (slot_size == 0) {
+      set_slot_size(bytes, align);
+    }
+    if (bytes > slot_size || slot_align % align != 0) {
+      throw std::bad_alloc();
+    }
+    std::uint32_t index;
+    if (free_head != no_slot) {
+      index = free_head;
+      std::memcpy(&free_head, address(index), sizeof(free_head));
+    }
+    else {
+      if (num_slots == capacity_for(bytes, align)) {
+        throw std::bad_alloc();
+      }
+      if (num_slots == chunks.size() * chunk_slots) {
+        add_chunk();
+      }
+      size_t chunk = chunks.size() - 1;
+      index = static_cast<std::uint32_t>(chunk << chunk_shift
+                                         | (num_slots - chunk * chunk_slots));
+      ++num_slots;
+    }
+    ++num_in_use;
+    return address(index);
+  }
+
+  // REQUIRES: 'slot' was returned by allocate() on this pool and has not
+  //           been freed since
+  // MODIFIES: this
+  // EFFECTS:  Returns 'slot' to the pool.
+  void deallocate(void *slot) {
+    assert(header_of(slot)->pool == this);
+    std::uint32_t index = index_of(slot);
+    std::memcpy(slot, &free_head, sizeof(free_head));
+    free_head = index;
+    --num_in_use;
+  }
+
+  // EFFECTS: Returns the number of slots this pool may hand out at once.
+  size_t capacity() const {
+    return pool_capacity;
+  }
+
+  // EFFECTS: Returns the number of slots of 'bytes' bytes aligned to
+  //          'align' this pool may hand out at once: capacity(), or fewer
+  //          if there are not that many indices for slots of that size.
+  //          Returns 0 if such slots do not fit in a chunk.
+  size_t capacity_for(size_t bytes, size_t align) const {
+    size_t size = round_slot_size(bytes, align);
+    if (size > chunk_room) {
+      return 0;
+    }
+    size_t per_chunk = chunk_room / size;
+    size_t shift = shift_for(per_chunk);
+    // The last index of the last chunk ends the free list when chunks
+    // hold a power of two slots
+    size_t indices = (size_t(1) << (32 - shift)) * per_chunk
+                     - (per_chunk == size_t(1) << shift);
+    return indices < pool_capacity ? indices : pool_capacity;
+  }
+
+  // EFFECTS: Returns the number of slots currently handed out.
+  size_t in_use() const {
+    return num_in_use;
+  }
+
+  // EFFECTS: Returns the number of bytes in each slot, or 0 before the
+  //          first allocation.
+  size_t slot_bytes() const {
+    return slot_size;
+  }
+
+  // REQUIRES: 'index' was returned by index_of for a slot of this pool
+  // EFFECTS:  Returns the slot named by 'index'.
+  void *address(std::uint32_t index) const {
+    return chunks[index >> chunk_shift] + sizeof(Chunk_header)
+           + (index & ((std::uint32_t(1) << chunk_shift) - 1)) * slot_size;
+  }
+
+  // REQUIRES: 'slot' was returned by allocate() on some NodePool
+  // EFFECTS:  Returns the index naming 'slot' in its pool.
+  static std::uint32_t index_of(const void *slot) {
+    const Chunk_header *header = header_of(slot);
+    const NodePool *pool = header->pool;
+    size_t offset = static_cast<const char *>(slot)
+                    - reinterpret_cast<const char *>(header + 1);
+    return static_cast<std::uint32_t>(header->number << pool->chunk_shift
+                                      | offset / pool->slot_size);
+  }
+
+  // REQUIRES: 'slot' was returned by allocate() on some NodePool, and
+  //           'index' names a slot of that same pool
+  // EFFECTS:  Returns the slot named by 'index'.
+  static void *address_near(const void *slot, std::uint32_t index) {
+    return header_of(slot)->pool->address(index);
+  }
+
+private:
+  // Ends the free list
+  static const std::uint32_t no_slot = UINT32_MAX;
+
+  // The start of every chunk
+  struct alignas(std::max_align_t) Chunk_header {
+    const NodePool *pool;
+    size_t number;
+  };
+
+  // The bytes of a chunk left for slots
+  static const size_t chunk_room = chunk_align - sizeof(Chunk_header);
+
+  std::vector<char *> blocks;
+  std::vector<char *> chunks;
+  char *next_window;
+  size_t windows_left;
+  size_t slot_size;
+  size_t slot_align;
+  size_t chunk_slots;
+  size_t chunk_shift;
+  size_t pool_capacity;
+  size_t num_slots;
+  size_t num_in_use;
+  std::uint32_t free_head;
+
+  // EFFECTS: Returns the header of the chunk holding 'slot'.
+  static const Chunk_header *header_of(const void *slot) {
+    std::uintptr_t p = reinterpret_cast<std::uintptr_t>(slot);
+    return reinterpret_cast<const Chunk_header *>(p & ~(chunk_align - 1));
+  }
+
+  // EFFECTS: Returns the size of a slot holding 'bytes' bytes, or a free
+  //          list index, aligned to 'align'.
+  static size_t round_slot_size(size_t bytes, size_t align) {
+    size_t size = bytes < sizeof(std::uint32_t) ? sizeof(std::uint32_t) : bytes;
+    return (size + align - 1) / align * align;
+  }
+
+  // EFFECTS: Returns the fewest bits that can number 'per_chunk' slots.
+  static size_t shift_for(size_t per_chunk) {
+    size_t shift = 0;
+    while ((size_t(1) << shift) < per_chunk) {
+      ++shift;
+    }
+    return shift;
+  }
+
+  // MODIFIES: this
+  // EFFECTS:  Fixes the size of every slot for 'bytes' bytes aligned to
+  //           'align', and how many slots a chunk holds.
+  void set_slot_size(size_t bytes, size_t align) {
+    size_t size = round_slot_size(bytes, align);
+    if (align > alignof(std::max_align_t) || size > chunk_room) {
+      throw std::bad_alloc();
+    }
+    slot_size = size;
+    slot_align = align;
+    chunk_slots = chunk_room / size;
+    chunk_shift = shift_for(chunk_slots);
+  }
+
+  // MODIFIES: this
+  // EFFECTS:  Sets up the next chunk, allocating a new block of windows
+  //           when the last one is used up.
+  void add_chunk() {
+    if (windows_left == 0) {
+      // Each block doubles the number of chunks
+      size_t count = chunks.empty() ? 1 : chunks.size();
+      count = count < max_block_chunks ? count : max_block_chunks;
+      char *block = static_cast<char *>(
+        ::operator new((count + 1) * chunk_align));
+      try {
+        blocks.push_back(block);
+      }
+      catch (...) {
+        ::operator delete(block);
+        throw;
+      }
+      std::uintptr_t p = reinterpret_cast<std::uintptr_t>(block);
+      std::uintptr_t first = (p + chunk_align - 1) & ~(chunk_align - 1);
+      next_window = block + (first - p);
+      windows_left = count;
+    }
+    chunks.push_back(next_window);
+    new (next_window) Chunk_header{this, chunks.size() - 1};
+    next_window += chunk_align;
+    --windows_left;
+  }
+};
+
+template <typename T>
+class NodePoolAllocator {
+  // OVERVIEW: A std::allocator-compatible allocator that takes one object
+  //           at a time from a NodePool. Two NodePoolAllocators compare
+  //           equal when they share a NodePool. It declares packs_nodes
+  //           and maps slots to indices, so a BinarySearchTree using it
+  //           links its nodes by 32-bit index and keeps 32-bit counts in
+  //           them (see Packed_nodes in BinarySearchTree.hpp).
+
+public:
+  using value_type = T;
+  using packs_nodes = std::true_type;
+
+  NodePoolAllocator(NodePool &pool_in)
+    : pool(&pool_in) { }
+
+  // Converting constructor, used when a container rebinds the allocator
+  // to its node type
+  template <typename U>
+  NodePoolAllocator(const NodePoolAllocator<U> &other)
+    : pool(other.pool) { }
+
+  // EFFECTS: Returns a slot for one T. Throws std::bad_alloc if 'n' is
+  //          not 1 or the pool is full.
+  T *allocate(size_t n) {
+    if (n != 1) {
+      throw std::bad_alloc();
+    }
+    return static_cast<T *>(pool->allocate(sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T *p, size_t) {
+    pool->deallocate(p);
+  }
+
+  // EFFECTS: Returns how many T the pool can hold at once.
+  size_t max_size() const {
+    return pool->capacity_for(sizeof(T), alignof(T));
+  }
+
+  // EFFECTS: Returns the index of 'slot' in its NodePool.
+  static std::uint32_t index_of(const void *slot) {
+    return NodePool::index_of(slot);
+  }
+
+  // EFFECTS: Returns the slot named by 'index' in the NodePool 'slot'
+  //          came from.
+  static void *address_near(const void *slot, std::uint32_t index) {
+    return NodePool::address_near(slot, index);
+  }
+
+  template <typename U>
+  bool operator==(const NodePoolAllocator<U> &rhs) const {
+    return pool == rhs.pool;
+  }
+
+  template <typename U>
+  bool operator!=(const NodePoolAllocator<U> &rhs) const {
+    return pool != rhs.pool;
+  }
+
+private:
+  template <typename U>
+  friend class NodePoolAllocator;
+
+  NodePool *pool;
+};
+
+#endif // NODE_POOL_HPP
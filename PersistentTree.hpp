@@ -0,0 +1,304 @@
+#ifndef PERSISTENT_TREE_HPP
+#define PERSISTENT_TREE_HPP
+/* PersistentTree.hpp
+ *
+ * A persistent (immutable, path-copying) AVL tree. Taking a snapshot is
+ * O(1), and an insertion after it copies only the O(log n) nodes on the
+ * path to the new element; everything else is shared between versions.
+ *
+ * BinarySearchTree cannot share nodes this way: its nodes point back to
+ * their parents and are relinked in place, so each node belongs to
+ * exactly one tree.
+ *
+ * Example (serving reads while training continues):
+ *   PersistentTree<int> tree;
+ *   tree.insert(5);
+ *   PersistentTree<int> view = tree.snapshot(); // hand to a reader thread
+ *   tree.insert(7);                             // view still holds {5}
+ */
+
+#include <cassert>    //assert
+#include <cstddef>    //size_t
+#include <functional> //less
+#include <algorithm>  //max
+#include <memory>     //shared_ptr, make_shared
+#include <utility>    //move
+
+template <typename T, typename Compare=std::less<T>>
+class PersistentTree {
+
+  // OVERVIEW: A handle to one version of an AVL tree whose nodes are
+  //           never modified after they are built. Copying a handle (or
+  //           calling snapshot()) shares the whole tree; insert()
+  //           builds a new version for this handle only. Nodes are
+  //           reference counted and freed when no version uses them.
+  //
+  // NOTE: A handle must only be used by one thread at a time, but
+  //       different handles may be used on different threads without
+  //       locks, even when they share nodes: shared nodes are immutable
+  //       and their reference counts are atomic.
+
+private:
+  struct Node;
+  using NodePtr = std::shared_ptr<const Node>;
+
+  // A Node stores an element, its children, and the height and size of
+  // the subtree rooted at it. All of these are fixed at construction.
+  struct Node {
+    Node(NodePtr left_in, const T &datum_in, NodePtr right_in)
+      : datum(datum_in), left(std::move(left_in)),
+        right(std::move(right_in)),
+        height(1 + std::max(height_impl(left.get()),
+                            height_impl(right.get()))),
+        size(1 + size_impl(left.get()) + size_impl(right.get())) { }
+
+    T datum;
+    NodePtr left;
+    NodePtr right;
+    int height;
+    size_t size;
+  };
+
+  // An AVL tree of any size that fits in memory is shorter than this
+  static const int max_height = 96;
+
+public:
+
+  class Iterator {
+    // OVERVIEW: Visits the elements of one version in order. It keeps the
+    //           path from the root to the current node, so it does not
+    //           need parent pointers. It must not outlive every handle to
+    //           its version.
+
+  public:
+    Iterator()
+      : depth(0) { }
+
+    const T &operator*() const {
+      assert(depth > 0);
+      return path[depth - 1]->datum;
+    }
+
+    const T *operator->() const {
+      return &**this;
+    }
+
+    // Prefix ++
+    Iterator &operator++() {
+      assert(depth > 0);
+      const Node *node = path[--depth];
+      push_left_spine(node->right.get());
+      return *this;
+    }
+
+    // Postfix ++ (implemented in terms of prefix ++)
+    Iterator operator++(int) {
+      Iterator result(*this);
+      ++(*this);
+      return result;
+    }
+
+    bool operator==(const Iterator &rhs) const {
+      return current() == rhs.current();
+    }
+
+    bool operator!=(const Iterator &rhs) const {
+      return !(*this == rhs);
+    }
+
+  private:
+    friend class PersistentTree;
+
+    // The nodes whose elements are still to be visited, the next one last
+    const Node *path[max_height];
+    int depth;
+
+    explicit Iterator(const Node *root)
+      : depth(0) {
+      push_left_spine(root);
+    }
+
+    void push_left_spine(const Node *node) {
+      for (; node; node = node->left.get()) {
+        assert(depth < max_height);
+        path[depth++] = node;
+      }
+    }
+
+    const Node *current() const {
+      return depth > 0 ? path[depth - 1] : nullptr;
+    }
+  };
+
+  // Default constructor - an empty tree
+  PersistentTree() = default;
+
+  // The copy constructor, assignment operator and destructor share or
+  // release the root, so they run in O(1), apart from freeing nodes no
+  // other version uses.
+
+  // EFFECTS: Returns a handle to the current version. Later changes to
+  //          this handle do not affect it. Runs in O(1).
+  PersistentTree snapshot() const {
+    return *this;
+  }
+
+  // EFFECTS: Returns whether this version is empty.
+  bool empty() const {
+    return !root;
+  }
+
+  // EFFECTS: Returns the number of elements in this version.
+  size_t size() const {
+    return size_impl(root.get());
+  }
+
+  // EFFECTS: Returns the height of this version.
+  size_t height() const {
+    return height_impl(root.get());
+  }
+
+  // EFFECTS: Returns a pointer to the element equivalent to 'query', or a
+  //          null pointer if there is none. The pointer stays valid while
+  //          any handle to this version exists.
+  template <typename K>
+  const T *find(const K &query) const {
+    const Node *node = root.get();
+    while (node) {
+      if (less(query, node->datum)) {
+        node = node->left.get();
+      }
+      else if (less(node->datum, query)) {
+        node = node->right.get();
+      }
+      else {
+        return &node->datum;
+      }
+    }
+    return nullptr;
+  }
+
+  // EFFECTS: Returns whether this version holds an element equivalent to
+  //          'query'.
+  template <typename K>
+  bool contains(const K &query) const {
+    return find(query) != nullptr;
+  }
+
+  // MODIFIES: this
+  // EFFECTS : If no element equivalent to 'item' is present, moves this
+  //           handle to a new version that also holds 'item' and returns
+  //           true. Otherwise returns false. Copies O(log n) nodes.
+  bool insert(const T &item) {
+    return insert_impl(item, false);
+  }
+
+  // MODIFIES: this
+  // EFFECTS : Same as insert, but an equivalent element that is already
+  //           present is replaced by 'item' in the new version.
+  bool insert_or_assign(const T &item) {
+    return insert_impl(item, true);
+  }
+
+  // MODIFIES: this
+  // EFFECTS : Drops this handle's reference to its version, leaving it
+  //           empty.
+  void clear() {
+    root.reset();
+  }
+
+  // EFFECTS: Returns an Iterator to the first element.
+  Iterator begin() const {
+    return Iterator(root.get());
+  }
+
+  // EFFECTS: Returns an Iterator to "past-the-end".
+  Iterator end() const {
+    return Iterator();
+  }
+
+private:
+  NodePtr root;
+  Compare less;
+
+  static int height_impl(const Node *node) {
+    return node ? node->height : 0;
+  }
+
+  static size_t size_impl(const Node *node) {
+    return node ? node->size : 0;
+  }
+
+  // EFFECTS: Builds the node (left, datum, right), rotating it into AVL
+  //          shape if the heights of 'left' and 'right' differ by two.
+  //          Nodes that change are built anew; no node is modified.
+  static NodePtr balance_impl(const NodePtr &left, const T &datum,
+                              const NodePtr &right) {
+    int left_height = height_impl(left.get());
+    int right_height = height_impl(right.get());
+    if (left_height > right_height + 1) {
+      const Node &l = *left;
+      if (height_impl(l.left.get()) >= height_impl(l.right.get())) {
+        return make_node(l.left, l.datum, make_node(l.right, datum, right));
+      }
+      const Node &lr = *l.right;
+      return make_node(make_node(l.left, l.datum, lr.left), lr.datum,
+                       make_node(lr.right, datum, right));
+    }
+    if (right_height > left_height + 1) {
+      const Node &r = *right;
+      if (height_impl(r.right.get()) >= height_impl(r.left.get())) {
+        return make_node(make_node(left, datum, r.left), r.datum, r.right);
+      }
+      const Node &rl = *r.left;
+      return make_node(make_node(left, datum, rl.left), rl.datum,
+                       make_node(rl.right, r.datum, r.right));
+    }
+    return make_node(left, datum, right);
+  }
+
+  static NodePtr make_node(const NodePtr &left, const T &datum,
+                           const NodePtr &right) {
+    return std::make_shared<const Node>(left, datum, right);
+  }
+
+  // MODIFIES: this
+  // EFFECTS : Inserts 'item' (replacing an equivalent element if
+  //           'replace' is true) by copying the path from the root down to
+  //           it, bottom-up. Returns whether 'item' was new.
+  bool insert_impl(const T &item, bool replace) {
+    const Node *path[max_height];
+    bool went_left[max_height];
+    int depth = 0;
+    const Node *node = root.get();
+    while (node) {
+      bool go_left = less(item, node->datum);
+      if (!go_left && !less(node->datum, item)) {
+        break;
+      }
+      assert(depth < max_height);
+      path[depth] = node;
+      went_left[depth] = go_left;
+      ++depth;
+      node = go_left ? node->left.get() : node->right.get();
+    }
+    if (node && !replace) {
+      return false;
+    }
+
+    bool inserted = !node;
+    NodePtr built = node ? make_node(node->left, item, node->right)
+                         : make_node(nullptr, item, nullptr);
+    while (depth > 0) {
+      --depth;
+      const Node *parent = path[depth];
+      built = went_left[depth]
+                ? balance_impl(built, parent->datum, parent->right)
+                : balance_impl(parent->left, parent->datum, built);
+    }
+    root = std::move(built);
+    return inserted;
+  }
+};
+
+#endif // PERSISTENT_TREE_HPP
@@ -0,0 +1,102 @@
+#include "PersistentTree.hpp"
+#include "unit_test_framework.hpp"
+#include <cmath>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+TEST(persistent_ctor) {
+    PersistentTree<int> tree;
+    ASSERT_TRUE(tree.empty());
+    ASSERT_EQUAL(tree.size(), 0);
+    ASSERT_EQUAL(tree.height(), 0);
+    ASSERT_TRUE(tree.begin() == tree.end());
+    ASSERT_FALSE(tree.contains(3));
+}
+
+TEST(persistent_insert_matches_std_set) {
+    PersistentTree<int> tree;
+    std::set<int> expected;
+    std::mt19937 gen(280);
+    for (int i = 0; i < 5000; ++i) {
+        int k = gen() % 3000;
+        ASSERT_EQUAL(tree.insert(k), expected.insert(k).second);
+    }
+    ASSERT_EQUAL(tree.size(), expected.size());
+    ASSERT_TRUE(tree.height() <= 1.44 * std::log2(tree.size() + 2));
+
+    auto expected_it = expected.begin();
+    for (int e : tree) {
+        ASSERT_EQUAL(e, *expected_it++);
+    }
+    ASSERT_TRUE(expected_it == expected.end());
+}
+
+TEST(persistent_snapshots_are_unchanged) {
+    PersistentTree<int> tree;
+    std::vector<PersistentTree<int>> versions;
+    for (int i = 0; i < 200; ++i) {
+        versions.push_back(tree.snapshot());
+        tree.insert(i);
+    }
+
+    for (int v = 0; v < 200; ++v) {
+        ASSERT_EQUAL(versions[v].size(), v);
+        ASSERT_EQUAL(versions[v].contains(v), false);
+        int expected = 0;
+        for (int e : versions[v]) {
+            ASSERT_EQUAL(e, expected++);
+        }
+        ASSERT_EQUAL(expected, v);
+    }
+
+    // Dropping the newest handle keeps older versions alive
+    tree.clear();
+    ASSERT_TRUE(tree.empty());
+    ASSERT_EQUAL(versions[199].size(), 199);
+}
+
+TEST(persistent_insert_or_assign) {
+    using Entry = std::pair<std::string, int>;
+    struct KeyLess {
+        bool operator()(const Entry &a, const Entry &b) const {
+            return a.first < b.first;
+        }
+    };
+    PersistentTree<Entry, KeyLess> counts;
+    ASSERT_TRUE(counts.insert_or_assign({"apple", 1}));
+    PersistentTree<Entry, KeyLess> before = counts.snapshot();
+    ASSERT_FALSE(counts.insert({"apple", 5}));
+    ASSERT_FALSE(counts.insert_or_assign({"apple", 2}));
+
+    ASSERT_EQUAL(counts.find(Entry{"apple", 0})->second, 2);
+    ASSERT_EQUAL(before.find(Entry{"apple", 0})->second, 1);
+    ASSERT_EQUAL(counts.size(), 1);
+}
+
+TEST(persistent_reader_thread) {
+    PersistentTree<int> tree;
+    for (int i = 0; i < 1000; ++i) {
+        tree.insert(i);
+    }
+    PersistentTree<int> view = tree.snapshot();
+
+    long sum = 0;
+    std::thread reader([&view, &sum]() {
+        for (int e : view) {
+            sum += e;
+        }
+    });
+    for (int i = 1000; i < 2000; ++i) {
+        tree.insert(i);
+    }
+    reader.join();
+
+    ASSERT_EQUAL(sum, 999L * 1000 / 2);
+    ASSERT_EQUAL(tree.size(), 2000);
+}
+
+TEST_MAIN()
@@ -0,0 +1,504 @@
+#ifndef SERIALIZE_HPP
+#define SERIALIZE_HPP
+/* Serialize.hpp
+ *
+ * A compact binary format for the sorted contents of a BinarySearchTree
+ * or Map, used by their serialize() and deserialize() members and by
+ * MappedMap, which answers lookups straight from a memory-mapped file.
+ *
+ * FORMAT (version 1, all integers little-endian)
+ *   offset 0   char[4]  magic "P5ML"
+ *          4   u32      version
+ *          8   u64      number of elements
+ *          16  u64      size of the string pool in bytes
+ *          24  u32      fields per element: 1, or 2 for a std::pair
+ *          28  u8[2]    kind of each field (see SerialKind)
+ *          30  u8[2]    reserved, zero
+ *          32           string pool: the bytes of every string field,
+ *                       back to back in element order
+ *                       zero padding up to a multiple of 8
+ *                       records: one 8-byte word per field per
+ *                       element, in sorted order
+ *
+ * Each word holds an integer (sign-extended to 64 bits), the bits of a
+ * double, or, for a string, its offset in the pool in the low 32 bits and
+ * its length in the high 32 bits. Every record has the same size, so a
+ * reader can binary search the records without decoding them. Readers
+ * check that each string they decode lies inside the pool, so a corrupt
+ * image throws serialize_exception rather than reading past it.
+ *
+ * Supported element types are integers, floating-point numbers,
+ * std::string, and std::pair of two of those.
+ */
+
+#include <algorithm>   //min
+#include <cstdint>     //uint8_t, uint32_t, uint64_t
+#include <cstring>     //memcpy, memcmp
+#include <cstddef>     //size_t, ptrdiff_t
+#include <exception>   //exception
+#include <istream>     //istream
+#include <iterator>    //input_iterator_tag
+#include <ostream>     //ostream
+#include <string>      //string
+#include <string_view> //string_view
+#include <type_traits> //enable_if_t, is_integral_v, is_floating_point_v
+#include <utility>     //pair
+
+// Thrown when a serialized image cannot be read or written
+class serialize_exception : public std::exception {
+public:
+  const char * what () const noexcept override {
+    return msg.c_str();
+  }
+  const std::string msg;
+  serialize_exception(const std::string &msg) : msg(msg) {};
+};
+
+// The kind of value stored in a field, as recorded in the header
+enum SerialKind : uint8_t {
+  serial_signed = 1,
+  serial_unsigned = 2,
+  serial_float = 3,
+  serial_string = 4
+};
+
+inline constexpr char serial_magic[4] = {'P', '5', 'M', 'L'};
+inline constexpr uint32_t serial_version = 1;
+inline constexpr size_t serial_header_size = 32;
+
+// serial_read_image reads an image in pieces this large, so the memory it
+// takes grows with the bytes actually read rather than with the sizes a
+// (possibly corrupt) header claims.
+inline constexpr size_t serial_read_chunk = 1 << 20;
+
+// EFFECTS: Writes 'value' to 'out' as 'bytes' little-endian bytes.
+inline void serial_put(char *out, uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; ++i) {
+    out[i] = static_cast<char>((value >> (8 * i)) & 0xff);
+  }
+}
+
+// EFFECTS: Returns the little-endian integer in the 'bytes' bytes at 'in'.
+inline uint64_t serial_get(const char *in, int bytes) {
+  uint64_t value = 0;
+  for (int i = 0; i < bytes; ++i) {
+    value |= uint64_t(static_cast<unsigned char>(in[i])) << (8 * i);
+  }
+  return value;
+}
+
+// EFFECTS: Returns the offset of the first record in an image whose
+//          string pool is 'pool_size' bytes.
+inline uint64_t serial_records_offset(uint64_t pool_size) {
+  return (serial_header_size + pool_size + 7) / 8 * 8;
+}
+
+// How one field of an element is encoded. Only the specializations below
+// exist, so serializing an unsupported type fails to compile.
+//   kind          the SerialKind recorded in the header
+//   View          what a reader gets back without allocating
+//   pool_bytes()  how many bytes the field adds to the string pool
+//   write_pool()  writes those bytes
+//   encode()      the field's record word, given its offset in the pool
+//   check()       throws serialize_exception if a word read back does not
+//                 fit a pool of the given size
+//   view()        reads a field back as a View, checking it first
+//   decode()      reads a field back as a T
+template <typename T, typename Enable = void>
+struct SerialField;
+
+template <typename T>
+struct SerialField<T, std::enable_if_t<std::is_integral_v<T>>> {
+  static const uint8_t kind = std::is_signed_v<T> ? serial_signed
+                                                  : serial_unsigned;
+  using View = T;
+
+  static uint64_t pool_bytes(const T &) {
+    return 0;
+  }
+
+  static void write_pool(std::ostream &, const T &) { }
+
+  static uint64_t encode(const T &value, uint64_t) {
+    return static_cast<uint64_t>(static_cast<int64_t>(value));
+  }
+
+  static void check(uint64_t, uint64_t) { }
+
+  static View view(uint64_t word, const char *, uint64_t) {
+    return static_cast<T>(word);
+  }
+
+  static T decode(uint64_t word, const char *pool, uint64_t pool_size) {
+    return view(word, pool, pool_size);
+  }
+};
+
+template <typename T>
+struct SerialField<T, std::enable_if_t<std::is_floating_point_v<T>>> {
+  static const uint8_t kind = serial_float;
+  using View = T;
+
+  static uint64_t pool_bytes(const T &) {
+    return 0;
+  }
+
+  static void write_pool(std::ostream &, const T &) { }
+
+  static uint64_t encode(const T &value, uint64_t) {
+    double wide = value;
+    uint64_t word;
+    std::memcpy(&word, &wide, sizeof(word));
+    return word;
+  }
+
+  static void check(uint64_t, uint64_t) { }
+
+  static View view(uint64_t word, const char *, uint64_t) {
+    double wide;
+    std::memcpy(&wide, &word, sizeof(wide));
+    return static_cast<T>(wide);
+  }
+
+  static T decode(uint64_t word, const char *pool, uint64_t pool_size) {
+    return view(word, pool, pool_size);
+  }
+};
+
+template <>
+struct SerialField<std::string> {
+  static const uint8_t kind = serial_string;
+  using View = std::string_view;
+
+  static uint64_t pool_bytes(const std::string &value) {
+    return value.size();
+  }
+
+  static void write_pool(std::ostream &os, const std::string &value) {
+    os.write(value.data(), static_cast<std::streamsize>(value.size()));
+  }
+
+  static uint64_t encode(const std::string &value, uint64_t pool_offset) {
+    if (pool_offset + value.size() > UINT32_MAX) {
+      throw serialize_exception("String pool is larger than 4 GiB");
+    }
+    return pool_offset | (uint64_t(value.size()) << 32);
+  }
+
+  static void check(uint64_t word, uint64_t pool_size) {
+    if ((word & UINT32_MAX) + (word >> 32) > pool_size) {
+      throw serialize_exception("Serialized string is outside the string "
+                                "pool");
+    }
+  }
+
+  static View view(uint64_t word, const char *pool, uint64_t pool_size) {
+    check(word, pool_size);
+    return View(pool + (word & UINT32_MAX), word >> 32);
+  }
+
+  static std::string decode(uint64_t word, const char *pool,
+                            uint64_t pool_size) {
+    return std::string(view(word, pool, pool_size));
+  }
+};
+
+// How a whole element is encoded: one field, or two for a std::pair.
+// The pair's members may be const, as in the elements of a Map.
+template <typename T>
+struct SerialRecord {
+  static const uint32_t field_count = 1;
+  using Field = SerialField<std::remove_const_t<T>>;
+
+  static void kinds(uint8_t *out) {
+    out[0] = Field::kind;
+  }
+
+  static uint64_t pool_bytes(const T &value) {
+    return Field::pool_bytes(value);
+  }
+
+  static void write_pool(std::ostream &os, const T &value) {
+    Field::write_pool(os, value);
+  }
+
+  static void encode(const T &value, uint64_t pool_offset, char *out) {
+    serial_put(out, Field::encode(value, pool_offset), 8);
+  }
+
+  static void check(const char *record, uint64_t pool_size) {
+    Field::check(serial_get(record, 8), pool_size);
+  }
+
+  static std::remove_const_t<T> decode(const char *record, const char *pool,
+                                       uint64_t pool_size) {
+    return Field::decode(serial_get(record, 8), pool, pool_size);
+  }
+};
+
+template <typename A, typename B>
+struct SerialRecord<std::pair<A, B>> {
+  static const uint32_t field_count = 2;
+  using First = SerialRecord<A>;
+  using Second = SerialRecord<B>;
+
+  static void kinds(uint8_t *out) {
+    First::kinds(out);
+    Second::kinds(out + 1);
+  }
+
+  static uint64_t pool_bytes(const std::pair<A, B> &value) {
+    return First::pool_bytes(value.first) + Second::pool_bytes(value.second);
+  }
+
+  static void write_pool(std::ostream &os, const std::pair<A, B> &value) {
+    First::write_pool(os, value.first);
+    Second::write_pool(os, value.second);
+  }
+
+  static void encode(const std::pair<A, B> &value, uint64_t pool_offset,
+                     char *out) {
+    First::encode(value.first, pool_offset, out);
+    Second::encode(value.second,
+                   pool_offset + First::pool_bytes(value.first), out + 8);
+  }
+
+  static void check(const char *record, uint64_t pool_size) {
+    First::check(record, pool_size);
+    Second::check(record + 8, pool_size);
+  }
+
+  static std::pair<A, B> decode(const char *record, const char *pool,
+                                uint64_t pool_size) {
+    return std::pair<A, B>(First::decode(record, pool, pool_size),
+                           Second::decode(record + 8, pool, pool_size));
+  }
+};
+
+// REQUIRES: [first, last) holds 'count' elements in sorted order, and can
+//           be traversed twice
+// MODIFIES: os
+// EFFECTS : Writes the elements as a complete image: the header, then
+//           the string pool (first pass), then the records (second pass).
+//           Throws serialize_exception if the stream fails.
+template <typename T, typename ForwardIt>
+void serialize_range(std::ostream &os, ForwardIt first, ForwardIt last,
+                     uint64_t count) {
+  using Record = SerialRecord<T>;
+  uint64_t pool_size = 0;
+  for (ForwardIt it = first; it != last; ++it) {
+    pool_size += Record::pool_bytes(*it);
+  }
+
+  char header[serial_header_size] = {};
+  std::memcpy(header, serial_magic, sizeof(serial_magic));
+  serial_put(header + 4, serial_version, 4);
+  serial_put(header + 8, count, 8);
+  serial_put(header + 16, pool_size, 8);
+  serial_put(header + 24, Record::field_count, 4);
+  Record::kinds(reinterpret_cast<uint8_t *>(header + 28));
+  os.write(header, serial_header_size);
+
+  for (ForwardIt it = first; it != last; ++it) {
+    Record::write_pool(os, *it);
+  }
+  char padding[8] = {};
+  os.write(padding, static_cast<std::streamsize>(
+             serial_records_offset(pool_size) - serial_header_size
+             - pool_size));
+
+  char record[8 * Record::field_count];
+  uint64_t pool_offset = 0;
+  for (ForwardIt it = first; it != last; ++it) {
+    Record::encode(*it, pool_offset, record);
+    pool_offset += Record::pool_bytes(*it);
+    os.write(record, sizeof(record));
+  }
+  if (!os) {
+    throw serialize_exception("Error writing serialized data");
+  }
+}
+
+template <typename T>
+class SerialView {
+  // OVERVIEW: Read-only access to the elements of a serialized image that
+  //           is already in memory, such as a buffer read from a stream
+  //           or a memory-mapped file. Nothing is copied; the memory must
+  //           outlive the SerialView.
+
+  using Record = SerialRecord<T>;
+
+public:
+  // Bytes per record
+  static const size_t record_size = 8 * Record::field_count;
+
+  // EFFECTS: Checks the header of the 'length' bytes at 'data' and that
+  //          it describes elements of type T. Throws serialize_exception
+  //          if it does not, or if the image is truncated. The records
+  //          are not read here: each string is checked against the pool
+  //          when it is decoded, or all at once by check_strings().
+  SerialView(const char *data, size_t length) {
+    if (length < serial_header_size
+        || std::memcmp(data, serial_magic, sizeof(serial_magic)) != 0) {
+      throw serialize_exception("Not a serialized tree");
+    }
+    if (serial_get(data + 4, 4) != serial_version) {
+      throw serialize_exception("Unsupported serialized tree version");
+    }
+    uint8_t kinds[2] = {};
+    Record::kinds(kinds);
+    if (serial_get(data + 24, 4) != Record::field_count
+        || std::memcmp(data + 28, kinds, Record::field_count) != 0) {
+      throw serialize_exception("Serialized tree has a different element "
+                                "type");
+    }
+    uint64_t count = serial_get(data + 8, 8);
+    pool_size = serial_get(data + 16, 8);
+    if (pool_size > length
+        || serial_records_offset(pool_size) > length
+        || (length - serial_records_offset(pool_size)) / record_size
+           < count) {
+      throw serialize_exception("Serialized tree is truncated");
+    }
+    num_records = static_cast<size_t>(count);
+    pool = data + serial_header_size;
+    records = data + serial_records_offset(pool_size);
+  }
+
+  // EFFECTS: Throws serialize_exception unless every string field of
+  //          every record lies inside the string pool. Takes O(n); use it
+  //          before decoding elements that cannot be undone part way.
+  void check_strings() const {
+    for (size_t i = 0; i < num_records; ++i) {
+      Record::check(record(i), pool_size);
+    }
+  }
+
+  // EFFECTS: Returns the number of elements in the image.
+  size_t size() const {
+    return num_records;
+  }
+
+  // EFFECTS: Returns the bytes of the record at 'index'.
+  const char *record(size_t index) const {
+    return records + index * record_size;
+  }
+
+  // EFFECTS: Returns the string pool that record fields point into.
+  const char *string_pool() const {
+    return pool;
+  }
+
+  // EFFECTS: Returns the size of the string pool in bytes.
+  uint64_t string_pool_size() const {
+    return pool_size;
+  }
+
+  // EFFECTS: Returns a copy of the element at 'index'. Throws
+  //          serialize_exception if one of its strings lies outside the
+  //          string pool.
+  std::remove_const_t<T> element(size_t index) const {
+    return Record::decode(record(index), pool, pool_size);
+  }
+
+  class Iterator {
+    // OVERVIEW: Decodes the elements in order, one copy per dereference.
+    //           It returns copies, not references into the view, so it
+    //           is only an input iterator.
+
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = std::remove_const_t<T>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type *;
+    using reference = value_type;
+
+    Iterator()
+      : view(nullptr), index(0) { }
+
+    value_type operator*() const {
+      return view->element(index);
+    }
+
+    Iterator &operator++() {
+      ++index;
+      return *this;
+    }
+
+    Iterator operator++(int) {
+      Iterator result(*this);
+      ++index;
+      return result;
+    }
+
+    bool operator==(const Iterator &rhs) const {
+      return index == rhs.index;
+    }
+
+    bool operator!=(const Iterator &rhs) const {
+      return index != rhs.index;
+    }
+
+  private:
+    friend class SerialView;
+
+    const SerialView *view;
+    size_t index;
+
+    Iterator(const SerialView *view_in, size_t index_in)
+      : view(view_in), index(index_in) { }
+  };
+
+  Iterator begin() const {
+    return Iterator(this, 0);
+  }
+
+  Iterator end() const {
+    return Iterator(this, num_records);
+  }
+
+private:
+  const char *pool;
+  uint64_t pool_size;
+  const char *records;
+  size_t num_records;
+};
+
+// MODIFIES: is
+// EFFECTS : Reads one complete image from 'is' (the header, then the rest
+//           in pieces of serial_read_chunk bytes) and returns its bytes.
+//           Throws serialize_exception if the stream ends early or the
+//           header claims an image too large to hold.
+inline std::string serial_read_image(std::istream &is) {
+  std::string image(serial_header_size, '\0');
+  if (!is.read(&image[0], serial_header_size)
+      || std::memcmp(image.data(), serial_magic, sizeof(serial_magic)) != 0) {
+    throw serialize_exception("Not a serialized tree");
+  }
+  uint64_t count = serial_get(image.data() + 8, 8);
+  uint64_t pool_size = serial_get(image.data() + 16, 8);
+  uint64_t field_count = serial_get(image.data() + 24, 4);
+  if (field_count < 1 || field_count > 2) {
+    throw serialize_exception("Serialized tree has a different element type");
+  }
+  uint64_t limit = image.max_size();
+  if (pool_size > limit
+      || count > (limit - serial_records_offset(pool_size))
+                 / (8 * field_count)) {
+    throw serialize_exception("Serialized tree is too large");
+  }
+  uint64_t length = serial_records_offset(pool_size)
+                    + count * 8 * field_count;
+  while (image.size() < length) {
+    size_t start = image.size();
+    size_t chunk = static_cast<size_t>(
+      std::min<uint64_t>(length - start, serial_read_chunk));
+    image.resize(start + chunk);
+    if (!is.read(&image[start], static_cast<std::streamsize>(chunk))) {
+      throw serialize_exception("Serialized tree is truncated");
+    }
+  }
+  return image;
+}
+
+#endif // SERIALIZE_HPP
@@ -1,188 +1,237 @@
 /* TreePrint.hpp */
 
 #include <iostream>
-#include <iomanip>
 #include <string>
 #include <sstream>
-#include <cmath> // pow
-#include <set>
-#include <stack> // used in get_max_elt_width()
+#include <map>
+#include <vector>
 
 static const char* const c_leaf_branch_special = "/\\";
 
+static const int c_min_elt_width = 2;
+
+// Drawn in place of the root of each subtree that is cut off, shortened
+// to fit the column width if need be
+static const char* const c_elided_subtree = "...";
+
+// Trees are never laid out deeper than this, so grid coordinates fit in
+// a long long
+static const size_t c_max_layout_levels = 60;
+
 /*
- * A class to represent the non-whitespace squares of output using a
- * grid-based tree printing scheme.
- * Holds x and y coordinates and a value, which could be either the
- * value held by a particular tree node or one of / or \ to improve
- * readability of the printed tree.
+ * Lays out the top levels of a tree on a grid and prints it.
+ * Nodes at depth d sit on row 2d, and the / and \ branches below them
+ * on row 2d + 1. The root is at x = 0, and the children of a node at
+ * depth d are 2^(levels - d - 2) columns to either side of it, so the
+ * tree spreads wider the taller the drawing is. Each column is as wide
+ * as the widest element drawn.
+ *
+ * Levels are added one at a time, starting from the root, for as long
+ * as the drawing stays within the depth and width limits, so the work
+ * done is bounded by the size of what is printed.
  */
-template <typename U, typename C>
-class BinarySearchTree<U, C>::Tree_grid_square {
+template <typename U, typename C, typename B, typename A>
+class BinarySearchTree<U, C, B, A>::Tree_layout {
 public:
-  template<typename T>
-  Tree_grid_square(int x_, int y_, T value_) : x(x_), y(y_) {
-      std::ostringstream oss;
-      oss << value_;
-      value = oss.str();
-  }
-
-  // Probe ctor
-  Tree_grid_square(int x_, int y_) : x(x_), y(y_) { }
 
-  /*
-   * A square is considered less than another if it is closer to the
-   * root of the tree. If two squares are at the same y coordinate,
-   * whichever one is farthest left is considered less.
-   * This ordering is solely for the purpose of storing in a sorted
-   * container.
-   */
-  bool operator<(const Tree_grid_square& rhs) const {
-      if (y < rhs.y) {
-          return true;
+  Tree_layout(const BinarySearchTree& tree, size_t max_depth,
+              size_t max_width) : node_width(c_min_elt_width),
+                                  leftmost_x(0), rightmost_x(0) {
+      if (!tree.root) {
+          return;
       }
-      if (y == rhs.y) {
-          return x < rhs.x;
+      max_depth = std::max<size_t>(1, std::min(max_depth,
+                                               c_max_layout_levels - 1));
+      nodes.push_back(std::vector<const Node*>(1, tree.root));
+      values.push_back(std::vector<std::string>(1, value_of(tree.root)));
+      nodes.push_back(children_of(nodes.back()));
+      place();
+
+      while (nodes.size() <= max_depth && !nodes.back().empty()) {
+          values.push_back(std::vector<std::string>());
+          for (const Node* node : nodes.back()) {
+              values.back().push_back(value_of(node));
+          }
+          nodes.push_back(children_of(nodes.back()));
+          Tree_layout wider(*this);
+          wider.place();
+          if (!wider.fits(max_width)) {
+              nodes.pop_back();
+              values.pop_back();
+              break;
+          }
+          *this = std::move(wider);
       }
-      return false;
   }
 
   /*
-   * Sends the value held at this coordinate to the given string
-   * stream.
+   * Prints the layout, starting each line with a newline.
    */
-  std::string get_value() const {
-      return value;
-  }
-
-  int get_x() const {
-      return x;
-  }
-
-  int get_y() const {
-      return y;
+  void print(std::ostream& os) const {
+      if (values.empty()) {
+          os << "( )";
+          return;
+      }
+      // Branches change the alignment used for the values printed after
+      // them, as they would on a stream whose adjustfield they set
+      bool align_left = false;
+      long long farthest_left = leftmost_x - node_width;
+      long long farthest_right = rightmost_x + node_width;
+      // Two printed lines per tree level: one for the values, one for the
+      // slash characters (branches), and a final blank line
+      for (size_t y = 0; y <= squares.size(); ++y) {
+          os << "\n";
+          std::map<long long, std::string> no_squares;
+          const auto& row = y < squares.size() ? squares[y] : no_squares;
+          auto square = row.lower_bound(farthest_left);
+          for (long long x = farthest_left; x <= farthest_right; ++x) {
+              if (square == row.end() || square->first != x) {
+                  os << std::string(size_t(node_width), ' ');
+                  continue;
+              }
+              const std::string& value = square->second;
+              if (value == "/") {
+                  align_left = false;
+                  pad(os, value, false);
+              } else if (value == "\\") {
+                  align_left = true;
+                  pad(os, value, true);
+              } else if (value == c_leaf_branch_special) {
+                  os << '\\' << std::string(size_t(node_width - 2), ' ')
+                     << '/';
+              } else {
+                  pad(os, value, align_left);
+              }
+              ++square;
+          } // for x
+      } // for y
   }
 
 private:
-  int x;
-  int y;
-  std::string value;
-};
-
-/*
- * Container to build and hold a set of Tree_grid_squares.
- */
-template <typename U, typename C>
-class BinarySearchTree<U, C>::Tree_grid {
-public:
+  // nodes[d] holds the nodes at depth d, from left to right. The last
+  // entry holds the roots of the subtrees that are cut off, if any.
+  std::vector<std::vector<const Node*>> nodes;
+  // values[d] holds the printed elements of nodes[d], for every level but
+  // the last
+  std::vector<std::vector<std::string>> values;
+  // squares[y] maps the x coordinate of each square on row y to what is
+  // drawn there
+  std::vector<std::map<long long, std::string>> squares;
+  int node_width;
+  long long leftmost_x;
+  long long rightmost_x;
+
+  static std::string value_of(const Node* node) {
+      std::ostringstream oss;
+      oss << node->datum;
+      return oss.str();
+  }
 
-  Tree_grid(const BinarySearchTree& tree) :
-          num_levels(static_cast<int>(tree.height())), leftmost_x(0),
-          rightmost_x(0) {
-      build(tree.root);
+  static std::vector<const Node*> children_of(
+          const std::vector<const Node*>& level) {
+      std::vector<const Node*> children;
+      for (const Node* node : level) {
+          if (node->left) {
+              children.push_back(node->left);
+          }
+          if (node->right) {
+              children.push_back(node->right);
+          }
+      }
+      return children;
   }
 
   /*
-   * Convenience wrapper of set::find(). Returns a pointer to the
-   * Tree_grid_square in the set or 0 if not found.
+   * Given the number of levels drawn and the index of the current level
+   * (0 being the root level), returns the horizontal distance (number of
+   * grid squares) between a node and one of its two children.
    */
-  const Tree_grid_square* find(const Tree_grid_square& coordinate) const {
-      typename std::set<Tree_grid_square>::iterator it =
-              coordinates.find(coordinate);
-      if (it == coordinates.end()) {
+  static long long calculate_x_offset(size_t num_levels,
+                                      size_t current_level) {
+      if (current_level + 2 > num_levels) {
           return 0;
       }
-      return &*it;
-  } // find wrapper
-
-  /*
-   * Returns the number of levels in the traversed tree.
-   */
-  int get_num_levels() const {
-      return num_levels;
-  } // get_num_levels
-
-  /*
-   * Returns the leftmost x coordinate in the traversed tree.
-   */
-  int get_leftmost_x() const {
-      return leftmost_x;
-  } // get_lowest_x
+      return 1LL << (num_levels - current_level - 2);
+  }
 
   /*
-   * Returns the rightmost x coordinate in the traversed tree.
+   * Fills in squares, node_width and the extent of the drawing for the
+   * levels in nodes.
    */
-  int get_rightmost_x() const {
-      return rightmost_x;
+  void place() {
+      bool elided = !nodes.back().empty();
+      size_t num_levels = values.size() + (elided ? 1 : 0);
+      squares.assign(2 * num_levels, std::map<long long, std::string>());
+      node_width = c_min_elt_width;
+      for (const auto& level : values) {
+          for (const std::string& value : level) {
+              node_width = std::max(node_width, int(value.length()));
+          }
+      }
+      std::string elided_value(c_elided_subtree, 0,
+                               std::min<size_t>(3, size_t(node_width)));
+      leftmost_x = 0;
+      rightmost_x = 0;
+
+      std::vector<long long> xs(1, 0);
+      for (size_t depth = 0; depth < num_levels; ++depth) {
+          long long x_offset = calculate_x_offset(num_levels, depth);
+          // Slashes indicating parent-child relationships.
+          long long branch_x_offset = x_offset <= 1 ? 1 : x_offset / 2;
+          std::vector<long long> child_xs;
+          for (size_t i = 0; i < nodes[depth].size(); ++i) {
+              long long x = xs[i];
+              const std::string& value = depth < values.size()
+                  ? values[depth][i] : elided_value;
+              leftmost_x = std::min(leftmost_x, x);
+              rightmost_x = std::max(rightmost_x, x);
+              squares[2 * depth].emplace(x, value);
+
+              auto& branches = squares[2 * depth + 1];
+              auto collision = branches.find(x - branch_x_offset);
+              if (collision != branches.end()) {
+                  // Special case where leaf branches collide.
+                  collision->second = c_leaf_branch_special;
+              } else {
+                  branches.emplace(x - branch_x_offset, "/");
+              }
+              branches.emplace(x + branch_x_offset, "\\");
+
+              if (nodes[depth][i]->left) {
+                  child_xs.push_back(x - x_offset);
+              }
+              if (nodes[depth][i]->right) {
+                  child_xs.push_back(x + x_offset);
+              }
+          }
+          xs = std::move(child_xs);
+      }
   }
 
-private:
-  std::set<Tree_grid_square> coordinates;
-  int num_levels;
-  int leftmost_x;
-  int rightmost_x;
-
   /*
-   * Given the height of a tree and the index of the current level (0
-   * being the root level), returns the horizontal distance (number of
-   * grid squares) between the current node and one of its two
-   * children.
-   *
-   * Note that in order for the tree to be printed elegantly, the
-   * horizontal distance between nodes must increase as the tree
-   * becomes taller.
+   * Returns whether each printed line is at most max_width characters.
    */
-  static int calculate_x_offset(int tree_height, int current_level) {
-      return int(std::pow(2, tree_height) / std::pow(2, current_level + 2));
+  bool fits(size_t max_width) const {
+      size_t columns = size_t(rightmost_x - leftmost_x + 1)
+                       + 2 * size_t(node_width);
+      return columns <= max_width / size_t(node_width);
   }
 
   /*
-   * Recursively fills the set of Node_coordinates
+   * Prints value padded with spaces to node_width, on the left or right.
    */
-  void build(const Node* root_node, int cur_x = 0, int cur_y = 0) {
-      if (!root_node) {
-          return;
+  void pad(std::ostream& os, const std::string& value,
+           bool align_left) const {
+      std::string padding;
+      if (value.length() < size_t(node_width)) {
+          padding.assign(size_t(node_width) - value.length(), ' ');
       }
-      coordinates.insert(Tree_grid_square(cur_x, cur_y,
-                                          root_node->datum));
-      if (cur_x < leftmost_x) {
-          leftmost_x = cur_x;
-      }
-      if (cur_x > rightmost_x) {
-          rightmost_x = cur_x;
-      }
-
-      int x_offset = calculate_x_offset(num_levels, cur_y / 2);
-
-      // Slashes indicating parent-child relationships.
-      int branch_x_offset = (x_offset) <= 1 ? 1 : x_offset / 2;
-
-      int left_branch_x = cur_x - branch_x_offset;
-      int left_branch_y = cur_y + 1;
-      Tree_grid_square left_branch(left_branch_x, left_branch_y, "/");
-
-      int right_branch_x = cur_x + branch_x_offset;
-      int right_branch_y = cur_y + 1;
-      Tree_grid_square right_branch(right_branch_x, right_branch_y, "\\");
-
-
-      // Special case where leaf branches collide.
-      typename std::set<Tree_grid_square>::iterator collision_iter =
-              coordinates.find(left_branch);
-      if (collision_iter != coordinates.end()) {
-          coordinates.erase(collision_iter);
-          coordinates.insert( Tree_grid_square(left_branch.get_x(),
-                                               left_branch.get_y(),
-                                               c_leaf_branch_special));
+      if (align_left) {
+          os << value << padding;
       } else {
-          coordinates.insert(left_branch);
+          os << padding << value;
       }
-
-      coordinates.insert(right_branch);
-
-      build(root_node->left, cur_x - x_offset, cur_y + 2);
-      build(root_node->right, cur_x + x_offset, cur_y + 2);
-  } // build
+  }
 };
 
 //--------------------------------------------------------------------
@@ -191,74 +240,16 @@ private:
  * Returns an (actually) human-readable string representation of the
  * tree
  */
-template <typename U, typename C>
-std::string BinarySearchTree<U, C>::to_string() const {
-    if (!root) {
-        return "( )";
-    }
-    int node_width = get_max_elt_width();
-    Tree_grid coordinates(*this);
-
+template <typename U, typename C, typename B, typename A>
+std::string BinarySearchTree<U, C, B, A>::to_string() const {
     std::ostringstream oss;
-    std::string padding(size_t(node_width), ' ');
-    int farthest_left = coordinates.get_leftmost_x() - node_width;
-    int farthest_right = coordinates.get_rightmost_x() + node_width;
-    // Two printed lines per tree level: one for the values, one for the
-    // slash characters (branches).
-    for (int y = 0; y <= coordinates.get_num_levels() * 2; ++y) {
-        oss << "\n";
-        for (int x = farthest_left; x <= farthest_right; ++x) {
-            const Tree_grid_square* tgs_ptr =
-                    coordinates.find( Tree_grid_square(x, y));
-            if (tgs_ptr) {
-                // TODO width field in square?
-                if (tgs_ptr->get_value() == "/") {
-                    oss << std::right;
-                    oss << std::setw(node_width);
-                    oss << tgs_ptr->get_value();
-                } else if (tgs_ptr->get_value() == "\\") {
-                    oss << std::left;
-                    oss << std::setw(node_width);
-                    oss << tgs_ptr->get_value();
-                } else if (tgs_ptr->get_value() == c_leaf_branch_special) {
-                    oss << '\\' << std::string(size_t(node_width - 2), ' ') << '/';
-                } else {
-                    oss << std::setw(node_width);
-                    oss << tgs_ptr->get_value();
-                }
-            } else {
-                oss << padding;
-            }
-        } // for x
-        // oss << "\n";
-    } // for y
+    print_tree(oss);
     return oss.str();
 } // to_string
 
-static const int c_min_elt_width = 2;
-
-/*
- * Returns the width of the widest elt in this tree.
- */
-template <typename U, typename C>
-int BinarySearchTree<U, C>::get_max_elt_width() const {
-    int current_max = c_min_elt_width;
-    std::stack<Node*> nodes;
-    nodes.push(root);
-    while (!nodes.empty()) {
-        Node* current = nodes.top();
-        nodes.pop();
-        if (!current) {
-            continue;
-        }
-        std::ostringstream oss;
-        oss << current->datum;
-        int width = int(oss.str().length());
-        if (width > current_max) {
-            current_max = width;
-        }
-        nodes.push(current->left);
-        nodes.push(current->right);
-    } // while
-    return current_max;
-} // get_max_elt_width
+template <typename U, typename C, typename B, typename A>
+void BinarySearchTree<U, C, B, A>::print_tree(std::ostream& os,
+                                              size_t max_depth,
+                                              size_t max_width) const {
+    Tree_layout(*this, max_depth, max_width).print(os);
+} // print_tree
@@ -2,17 +2,47 @@
 #include <map>
 #include <fstream>
 #include "csvstream.hpp"
+#include "Map.hpp"
 #include <set>
 #include <cmath>
+#include <string_view>
+
+/// @brief Orders (label, word) pairs like std::pair does, but also accepts
+///        pairs of string_views so they can be looked up without copying
+///        the strings into a new pair first
+struct LabelWordLess {
+    using is_transparent = void;
+
+    template <typename A, typename B>
+    bool operator()(const A& a, const B& b) const {
+        std::string_view aLabel = a.first, bLabel = b.first;
+        if(aLabel != bLabel)
+            return aLabel < bLabel;
+        return std::string_view(a.second) < std::string_view(b.second);
+    }
+};
 
 class Classifier {
+    using LabelWord = std::pair<std::string_view, std::string_view>;
+
     int _numPosts;
     int _numUniqueWords;
-    std::map<std::string, int> _postsWithWord;
-    std::map<std::string, int> _postsWithLabel;
-    std::map<std::pair<std::string, std::string>, int> _postsWithLabelWord;
+    Map<std::string, int, std::less<>, AvlBalance> _postsWithWord;
+    Map<std::string, int, std::less<>, AvlBalance> _postsWithLabel;
+    Map<std::pair<std::string, std::string>, int, LabelWordLess, AvlBalance>
+        _postsWithLabelWord;
     bool _debug;
 
+    /// @brief Looks up a count without inserting anything into the map
+    /// @param map The map to search
+    /// @param key The key to look up
+    /// @return The count stored for the key, or 0 if there is none
+    template <typename CountMap, typename Key>
+    static int countOf(const CountMap& map, const Key& key) {
+        auto it = map.find(key);
+        return it == map.end() ? 0 : (*it).second;
+    }
+
     /// @brief Returns the number of unique words in a string
     /// @param str The string to parse
     /// @return A set containing all of the unique words in the given string
@@ -63,13 +93,13 @@ class Classifier {
         const std::string& label
     ) {
         double total = 0;
+        int l = countOf(_postsWithLabel, label);
         for(const auto& word : uniqueWords) {
-            int CW  = _postsWithLabelWord[std::make_pair(label, word)];
-            int l = _postsWithLabel[label];
-            int w = _postsWithWord[word];
+            int CW  = countOf(_postsWithLabelWord, LabelWord(label, word));
+            int w = countOf(_postsWithWord, word);
             total += logLikelihood(CW, l, w);
         }
-        return logPrior(_postsWithLabel[label]) + total; 
+        return logPrior(l) + total; 
     }
 
 public:
@@ -90,14 +120,15 @@ public:
         // Read in each row of the training data
         std::map<std::string, std::string> inMap;
         while(csv >> inMap) {
-            _postsWithLabel[inMap["tag"]] += 1;
+            const std::string& tag = inMap["tag"];
+            _postsWithLabel[tag] += 1;
             auto words = uniqueWords(inMap["content"]);
 
             // Determine the number of times each word occurs
             // and how many times they occur for a given label
-            for(auto s : words) {
+            for(const auto& s : words) {
                 _postsWithWord[s] += 1;
-                _postsWithLabelWord[std::make_pair(inMap["tag"], s)] += 1;
+                _postsWithLabelWord[LabelWord(tag, s)] += 1;
             }
 
             _numPosts += 1;
@@ -135,8 +166,8 @@ public:
             for(const auto& e : _postsWithLabelWord) {
                 double res = logLikelihood(
                     e.second,
-                    _postsWithLabel.at(e.first.first),
-                    _postsWithWord.at(e.first.second)
+                    countOf(_postsWithLabel, e.first.first),
+                    countOf(_postsWithWord, e.first.second)
                 );
                 std::cout << "  " << e.first.first << ":" << e.first.second 
                     << ", count = " << e.second << ", "
@@ -189,6 +220,29 @@ public:
             << "performance: " << numPredictedCorrect << " / " << totalPredicted
             << " posts predicted correctly" << std::endl;
     }
+
+    /// @brief Prints the shape of each of the classifier's maps and, in a
+    ///        build with -DBST_INSTRUMENTATION, the work each one has done
+    ///        since the last call to resetStats
+    /// @param os The stream to print to
+    void printStats(std::ostream& os) const {
+        os << "posts with word:" << std::endl;
+        _postsWithWord.print_stats(os);
+        os << "posts with label:" << std::endl;
+        _postsWithLabel.print_stats(os);
+        os << "posts with label and word:" << std::endl;
+        _postsWithLabelWord.print_stats(os);
+    }
+
+#ifdef BST_INSTRUMENTATION
+    /// @brief Sets the work counted for each of the classifier's maps back
+    ///        to zero
+    void resetStats() {
+        _postsWithWord.reset_stats();
+        _postsWithLabel.reset_stats();
+        _postsWithLabelWord.reset_stats();
+    }
+#endif
 };
 
 /// @brief Logs an error message for command line argument errors
@@ -223,7 +277,16 @@ int main(int argc, char* argv[]) {
         Classifier classifier(debug);
 
         classifier.train(trainCsv);
+#ifdef BST_INSTRUMENTATION
+        std::cerr << "== after training ==" << std::endl;
+        classifier.printStats(std::cerr);
+        classifier.resetStats();
+#endif
         classifier.predict(testCsv);
+#ifdef BST_INSTRUMENTATION
+        std::cerr << "== after prediction ==" << std::endl;
+        classifier.printStats(std::cerr);
+#endif
     } catch(const csvstream_exception& e) {
         std::cout << e.what() << std::endl;
         return 2;